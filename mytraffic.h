@@ -0,0 +1,219 @@
+/*
+	User-space interface of the traffic light module
+
+	Shared status page:
+		- mmap() one page of /dev/mytrafficN read-only at offset 0 to get a struct mytraffic_shared
+		- The kernel updates it on every transition, so pollers read the state without any system call
+		- seq is odd while an update is in progress: read seq, copy the fields, and retry if seq was odd or changed
+
+	Binary status:
+		- ioctl(fd, MYTRAFFIC_IOC_GET_STATUS, &status) fills a struct mytraffic_status with the current state
+		- ioctl(fd, MYTRAFFIC_IOC_SET_FORMAT, MYTRAFFIC_FORMAT_BINARY) makes read() on this file return
+		  struct mytraffic_status records instead of text (one whole record per read)
+
+	Phase program:
+		- Normal and pedestrian mode step through a table of phases (lamps, duration, next phase,
+		  next phase when a pedestrian is waiting); the module starts in phase 0, and switching back to
+		  normal mode from another mode starts at the program's entry phase
+		- ioctl(fd, MYTRAFFIC_IOC_SET_PROGRAM, &program) replaces the program of that light; the current
+		  phase runs to its end and the new program continues at its entry phase (fd opened for writing)
+		- ioctl(fd, MYTRAFFIC_IOC_GET_PROGRAM, &program) returns the program in use
+		- Durations are in cycles of the current cycle rate, or in ms for phases with MYTRAFFIC_PHASE_MS
+		  (e.g. 45000 ms green, 4500 ms yellow), which don't follow rate changes
+		- Actuated phases (MYTRAFFIC_PHASE_ACTUATED) last `duration` (min green) without detector calls;
+		  each vehicle detected extends them to `gap` after the call, up to max_duration in total
+
+	Cycle rate:
+		- Rates are fixed point in mHz (cycle_rate_mhz), e.g. 250 = 0.25 Hz = 4 s cycles;
+		  cycle_rate fields hold the same rate in whole Hz (rounded down) for older readers
+
+	Coordination (green wave):
+		- ioctl(fd, MYTRAFFIC_IOC_SET_COORD, &coord) locks the light to a common cycle: its program's entry
+		  phase (green by default) starts only at epoch_ns + offset_ns + k * cycle_ns, by stretching the
+		  phase that leads back to it; lights sharing epoch and cycle with offsets along a corridor
+		  give progressive greens; like SET_PROGRAM it needs an fd opened for writing
+		- cycle_ns should be at least the length of one program cycle, else cycles are skipped
+		- Limits keep the grid arithmetic in range: 0 < cycle_ns <= MYTRAFFIC_MAX_COORD_CYCLE_NS,
+		  |offset_ns| < cycle_ns and |epoch_ns| <= MYTRAFFIC_MAX_COORD_EPOCH_NS, else -EINVAL
+		- enabled = 0 returns to free-running timing, MYTRAFFIC_IOC_GET_COORD returns the setting
+
+	Transition log:
+		- debugfs mytraffic/N/log streams struct mytraffic_log_entry records, one per handled event,
+		  oldest first; reading removes them (whole records only)
+		- mytraffic/N/log_overflows counts records dropped because nobody read the log in time
+
+	Record/replay:
+		- Opening debugfs mytraffic/N/record (one opener at a time) starts recording every input of that
+		  light's state machine: a MYTRAFFIC_REC_STATE record with the whole state first, then one record
+		  per handled event, rate write, program or coordination change, each with the outputs it produced
+		- A record may be followed by a payload of `size` bytes; reads block until data arrives, so
+		  cat record > incident.rec captures until interrupted, and closing the file stops the recording
+		- If the reader falls behind the recording stops: reads return what was captured, then -EOVERFLOW
+		- tools/mytraffic_replay runs a recording through the same state machine core in virtual time
+		  and reports the first output that differs
+
+*/
+
+#ifndef MYTRAFFIC_H
+#define MYTRAFFIC_H
+
+#include <linux/types.h>
+#include <linux/ioctl.h>
+
+// operational modes, same order as the module's opmode_t
+#define MYTRAFFIC_MODE_NORMAL 0
+#define MYTRAFFIC_MODE_FLASHING_RED 1
+#define MYTRAFFIC_MODE_FLASHING_YELLOW 2
+#define MYTRAFFIC_MODE_PEDESTRIAN 3
+#define MYTRAFFIC_MODE_LIGHTBULB_CHECK 4
+
+// events handled by the state machine, same order as the module's event_t
+#define MYTRAFFIC_EVENT_BTN_0_PRESS 0
+#define MYTRAFFIC_EVENT_BTN_1_PRESS 1
+#define MYTRAFFIC_EVENT_BOTH_BTNS_PRESS 2
+#define MYTRAFFIC_EVENT_TIMER_EXPIRE 3
+#define MYTRAFFIC_EVENT_DETECTOR 4
+#define MYTRAFFIC_EVENT_BTN_RELEASE 5
+
+// lamp bitmask, bit set = lamp on
+#define MYTRAFFIC_LAMP_RED (1U << 0)
+#define MYTRAFFIC_LAMP_YELLOW (1U << 1)
+#define MYTRAFFIC_LAMP_GREEN (1U << 2)
+
+// deadline_ns while no phase is timed (lightbulb check waits for the buttons to be released)
+#define MYTRAFFIC_NO_DEADLINE ((__s64)(~0ULL >> 1))
+
+#define MYTRAFFIC_SHARED_VERSION 2 // 2: cycle_rate_mhz
+#define MYTRAFFIC_STATUS_VERSION 2 // 2: cycle_rate_mhz
+
+#define MYTRAFFIC_MIN_RATE_MHZ 1
+#define MYTRAFFIC_MAX_RATE_MHZ 9000
+
+struct mytraffic_shared {
+    __u32 seq; // odd while the kernel is updating the page, incremented twice per update
+    __u32 version; // MYTRAFFIC_SHARED_VERSION
+    __u32 mode; // MYTRAFFIC_MODE_*
+    __u32 cycle_rate; // in Hz, rounded down
+    __u32 lamps; // MYTRAFFIC_LAMP_* bitmask
+    __u32 pedestrian_present;
+    __s64 deadline_ns; // CLOCK_MONOTONIC end of the current phase, or MYTRAFFIC_NO_DEADLINE
+    __u32 cycle_rate_mhz; // in mHz
+    __u32 reserved;
+};
+
+struct mytraffic_status {
+    __u32 version; // MYTRAFFIC_STATUS_VERSION
+    __u32 size; // sizeof(struct mytraffic_status)
+    __u32 mode; // MYTRAFFIC_MODE_*
+    __u32 cycle_rate; // in Hz, rounded down
+    __u32 lamps; // MYTRAFFIC_LAMP_* bitmask
+    __u32 pedestrian_present;
+    __u32 generation; // incremented on every change of mode, rate, lamps or pedestrian flag
+    __u32 cycle_rate_mhz; // in mHz
+    __s64 deadline_ns; // CLOCK_MONOTONIC end of the current phase, or MYTRAFFIC_NO_DEADLINE
+    __s64 changed_ns; // CLOCK_MONOTONIC time of the last change
+    __s64 last_lateness_ns; // phase timer lateness at the last fire
+    __s64 max_lateness_ns;
+    __u64 timer_fires;
+};
+
+struct mytraffic_log_entry {
+    __s64 time_ns; // CLOCK_MONOTONIC time of the button press or timer deadline
+    __u8 event; // MYTRAFFIC_EVENT_*
+    __u8 prev_mode; // MYTRAFFIC_MODE_* before the event
+    __u8 next_mode; // MYTRAFFIC_MODE_* after the event
+    __u8 lamps; // MYTRAFFIC_LAMP_* bitmask after the event
+    __u32 reserved;
+};
+
+#define MYTRAFFIC_RECORD_VERSION 3 // 2: struct mytraffic_fsm_state flags, 3: natural_deadline_ns
+
+// record types of the input recording
+#define MYTRAFFIC_REC_STATE 0 // payload: struct mytraffic_fsm_state, value: MYTRAFFIC_RECORD_VERSION
+#define MYTRAFFIC_REC_EVENT 1 // event and buttons handled at time_ns
+#define MYTRAFFIC_REC_RATE 2 // value: cycle rate in mHz written at time_ns
+#define MYTRAFFIC_REC_PROGRAM 3 // payload: struct mytraffic_program
+#define MYTRAFFIC_REC_COORD 4 // payload: struct mytraffic_coord
+
+struct mytraffic_record {
+    __s64 time_ns; // CLOCK_MONOTONIC time of the input
+    __s64 deadline_ns; // phase deadline after the input
+    __u32 value; // depends on type
+    __u16 size; // bytes of payload following the record
+    __u8 type; // MYTRAFFIC_REC_*
+    __u8 event; // MYTRAFFIC_REC_EVENT: MYTRAFFIC_EVENT_*
+    __u8 buttons; // MYTRAFFIC_REC_EVENT: buttons held after the event, bit 0 = button 0
+    __u8 mode; // MYTRAFFIC_MODE_* after the input
+    __u8 lamps; // MYTRAFFIC_LAMP_* bitmask after the input
+    __u8 pedestrian_present; // after the input
+    __u32 reserved;
+};
+
+#define MYTRAFFIC_MAX_PHASES 16
+#define MYTRAFFIC_PHASE_NONE 0xff // no pedestrian alternative
+#define MYTRAFFIC_PHASE_WALK (1U << 0) // pedestrians cross: reported as pedestrian mode, ends the pedestrian call
+#define MYTRAFFIC_PHASE_ACTUATED (1U << 1) // extended by vehicle detector calls (gap, max_duration)
+#define MYTRAFFIC_PHASE_MS (1U << 2) // durations in ms instead of cycles
+#define MYTRAFFIC_MAX_CYCLES 1000 // longest duration in cycles
+#define MYTRAFFIC_MAX_MS 3600000 // longest duration in ms
+
+struct mytraffic_phase {
+    __u8 lamps; // MYTRAFFIC_LAMP_* bitmask
+    __u8 flags; // MYTRAFFIC_PHASE_*
+    __u8 next; // phase that follows
+    __u8 ped_next; // phase that follows while a pedestrian is waiting, or MYTRAFFIC_PHASE_NONE
+    __u32 duration; // cycles or ms (MYTRAFFIC_PHASE_MS), minimum for actuated phases, at least 1
+    __u32 max_duration; // actuated: longest duration, at least duration
+    __u32 gap; // actuated: passage time a detector call extends the phase by, at least 1
+};
+
+struct mytraffic_program {
+    __u32 num_phases; // 1..MYTRAFFIC_MAX_PHASES
+    __u32 entry; // phase started when switching back to normal mode
+    struct mytraffic_phase phases[MYTRAFFIC_MAX_PHASES];
+};
+
+#define MYTRAFFIC_MAX_COORD_CYCLE_NS (86400LL * 1000000000LL) // one day
+#define MYTRAFFIC_MAX_COORD_EPOCH_NS (1LL << 62)
+
+struct mytraffic_coord {
+    __s64 epoch_ns; // CLOCK_MONOTONIC reference shared by the coordinated lights, |epoch_ns| <= 2^62
+    __s64 offset_ns; // this light's offset from the reference, |offset_ns| < cycle_ns
+    __s64 cycle_ns; // common cycle length, 1 ns .. 1 day
+    __u32 enabled;
+    __u32 reserved;
+};
+
+// how the current phase is timed
+#define MYTRAFFIC_FSM_CYCLE_TIMED (1U << 0) // lasts cycles: rate changes rescale it
+#define MYTRAFFIC_FSM_ON_GRID (1U << 1) // ends on the coordination grid
+
+// complete state of one light's state machine, the starting point of a recording
+struct mytraffic_fsm_state {
+    __s64 phase_start_ns;
+    __s64 deadline_ns;
+    __s64 max_deadline_ns; // latest end of an actuated phase
+    __s64 natural_deadline_ns; // end of the phase before it was stretched onto the coordination grid
+    __u32 mode; // MYTRAFFIC_MODE_*
+    __u32 lamps; // MYTRAFFIC_LAMP_* bitmask
+    __u32 cycle_rate_mhz;
+    __u32 pedestrian_present;
+    __u32 phase; // current phase of the program, or MYTRAFFIC_PHASE_NONE
+    __u32 flags; // MYTRAFFIC_FSM_*
+    struct mytraffic_program program;
+    struct mytraffic_coord coord;
+};
+
+// read() formats
+#define MYTRAFFIC_FORMAT_TEXT 0
+#define MYTRAFFIC_FORMAT_BINARY 1
+
+#define MYTRAFFIC_IOC_MAGIC 0xB7
+#define MYTRAFFIC_IOC_GET_STATUS _IOR(MYTRAFFIC_IOC_MAGIC, 1, struct mytraffic_status)
+#define MYTRAFFIC_IOC_SET_FORMAT _IO(MYTRAFFIC_IOC_MAGIC, 2) // argument: MYTRAFFIC_FORMAT_*
+#define MYTRAFFIC_IOC_SET_PROGRAM _IOW(MYTRAFFIC_IOC_MAGIC, 3, struct mytraffic_program)
+#define MYTRAFFIC_IOC_GET_PROGRAM _IOR(MYTRAFFIC_IOC_MAGIC, 4, struct mytraffic_program)
+#define MYTRAFFIC_IOC_SET_COORD _IOW(MYTRAFFIC_IOC_MAGIC, 5, struct mytraffic_coord)
+#define MYTRAFFIC_IOC_GET_COORD _IOR(MYTRAFFIC_IOC_MAGIC, 6, struct mytraffic_coord)
+
+#endif
@@ -0,0 +1,349 @@
+/*
+	Traffic light state machine core, see mytraffic_fsm.h
+
+	Built into the kernel module and, unchanged, into the user-space library in tools/
+*/
+
+#include "mytraffic_fsm.h"
+
+#ifdef __KERNEL__
+#include <linux/math64.h>		// div_u64, div64_s64
+#include <linux/string.h>		// memset
+#else
+#include <string.h>
+
+static inline u64 div_u64(u64 dividend, u32 divisor) {
+    return dividend / divisor;
+}
+
+static inline s64 div64_s64(s64 dividend, s64 divisor) {
+    return dividend / divisor;
+}
+#endif
+
+const char *const mode_names[NUM_MODES] = { "normal", "flashing-red", "flashing-yellow", "pedestrian-mode", "lightbulb-check" };
+const char *const event_names[NUM_EVENTS] = { "btn0-press", "btn1-press", "both-btns-press", "timer-expire", "detector", "btn-release" };
+
+opmode_t state_transition_table[NUM_EVENTS][NUM_MODES] = { // current mode vs. event
+                        /* NORMAL_MODE       FLASHING_RED      FLASHING_YELLOW      PEDESTRIAN_MODE     LIGHTBULB_CHECK*/
+    /* EVENT_BTN_0_PRESS */ {FLASHING_RED,   FLASHING_YELLOW,    NORMAL_MODE,   PEDESTRIAN_MODE,    NORMAL_MODE},
+    /* EVENT_BTN_1_PRESS */ {PEDESTRIAN_MODE,  FLASHING_RED,  FLASHING_YELLOW,   PEDESTRIAN_MODE,   NORMAL_MODE}, // only go to pedestrian mode from normal
+    /* EVENT_BOTH_BTNS_PRESS */ {LIGHTBULB_CHECK,   LIGHTBULB_CHECK,    LIGHTBULB_CHECK,    LIGHTBULB_CHECK,    LIGHTBULB_CHECK},
+    /* EVENT_TIMER_EXPIRE */ {NORMAL_MODE,   FLASHING_RED,   FLASHING_YELLOW,   NORMAL_MODE,    LIGHTBULB_CHECK}, // pedestrian mode will return to normal after timer expires, lightbulb check ignores any existing timers/their expirations
+    /* EVENT_DETECTOR */ {NORMAL_MODE,   FLASHING_RED,   FLASHING_YELLOW,   PEDESTRIAN_MODE,    LIGHTBULB_CHECK}, // vehicles only stretch actuated phases
+    /* EVENT_BTN_RELEASE */ {NORMAL_MODE,   FLASHING_RED,   FLASHING_YELLOW,   PEDESTRIAN_MODE,    LIGHTBULB_CHECK} // releases only end a lightbulb check
+};
+
+// 1 mHz = one cycle per 10^12 ns
+#define NSEC_PER_MHZ_CYCLE (1000ULL * NSEC_PER_SEC)
+
+static void set_cycle_rate(traffic_fsm_t *fsm, u32 cycle_rate_mhz) {
+    fsm->cycle_rate_mhz = cycle_rate_mhz;
+    fsm->cycle_ns = div_u64(NSEC_PER_MHZ_CYCLE, cycle_rate_mhz); // the only division, once per rate change
+}
+
+static s64 cycles_to_ns(const traffic_fsm_t *fsm, unsigned int cycles) {
+    return cycles * fsm->cycle_ns;
+}
+
+// a duration of `phase` in ns: ms, or cycles at the current rate
+static s64 phase_ns(const traffic_fsm_t *fsm, const struct mytraffic_phase *phase, u32 duration) {
+    return phase->flags & MYTRAFFIC_PHASE_MS ? (s64)duration * NSEC_PER_MSEC : cycles_to_ns(fsm, duration);
+}
+
+// set the deadline of a phase lasting `cycles` cycles from the current phase start
+static void schedule_phase(traffic_fsm_t *fsm, unsigned int cycles) {
+    fsm->deadline = fsm->phase_start + cycles_to_ns(fsm, cycles);
+    fsm->natural_deadline = fsm->deadline;
+    fsm->cycle_timed = true;
+    fsm->on_grid = false;
+}
+
+// normal cycle: red 2, green 3, yellow 1; a waiting pedestrian turns the red after yellow into red/yellow for 5
+static const struct mytraffic_program default_program = {
+    .num_phases = 4,
+    .entry = 1, // back to normal mode: start with green
+    .phases = {
+        { .lamps = LIGHT_RED, .duration = 2, .next = 1, .ped_next = MYTRAFFIC_PHASE_NONE },
+        { .lamps = LIGHT_GREEN, .duration = 3, .next = 2, .ped_next = MYTRAFFIC_PHASE_NONE },
+        { .lamps = LIGHT_YELLOW, .duration = 1, .next = 0, .ped_next = 3 },
+        { .lamps = LIGHT_RED | LIGHT_YELLOW, .flags = MYTRAFFIC_PHASE_WALK, .duration = 5, .next = 1, .ped_next = MYTRAFFIC_PHASE_NONE },
+    }
+};
+
+// first point of the common cycle grid at or after `time`
+static s64 next_sync_point(const struct mytraffic_coord *coord, s64 time) {
+    s64 reference = coord->epoch_ns + coord->offset_ns;
+    s64 cycles = div64_s64(time - reference, coord->cycle_ns); // rounds towards zero
+
+    if (reference + cycles * coord->cycle_ns < time) {
+        cycles++;
+    }
+    return reference + cycles * coord->cycle_ns;
+}
+
+// start phase `index` of the program at the current phase start
+static bool enter_phase(traffic_fsm_t *fsm, unsigned int index) {
+    const struct mytraffic_phase *phase = &fsm->program.phases[index];
+
+    fsm->phase = index;
+    fsm->status = phase->lamps;
+    fsm->mode = phase->flags & MYTRAFFIC_PHASE_WALK ? PEDESTRIAN_MODE : NORMAL_MODE;
+    fsm->deadline = fsm->phase_start + phase_ns(fsm, phase, phase->duration);
+    fsm->natural_deadline = fsm->deadline;
+    fsm->max_deadline = phase->flags & MYTRAFFIC_PHASE_ACTUATED ?
+        fsm->phase_start + phase_ns(fsm, phase, phase->max_duration) : fsm->deadline;
+    // kept with the phase: a new program may replace this one before it ends
+    fsm->cycle_timed = !(phase->flags & MYTRAFFIC_PHASE_MS);
+    fsm->on_grid = fsm->coord.enabled && phase->next == fsm->program.entry;
+    if (fsm->on_grid) {
+        // coordinated: extend the phase before the entry phase so the next one starts on the common grid
+        fsm->deadline = next_sync_point(&fsm->coord, fsm->deadline);
+    }
+    return true;
+}
+
+// state handlers, return true if they scheduled a new phase
+static bool handle_program(traffic_fsm_t *fsm, event_t event, opmode_t prev_mode) {
+    const struct mytraffic_phase *phase = fsm->phase < fsm->program.num_phases ? &fsm->program.phases[fsm->phase] : NULL;
+
+    if (prev_mode != NORMAL_MODE && prev_mode != PEDESTRIAN_MODE) {
+        return enter_phase(fsm, fsm->program.entry); // switching back from another mode
+    }
+
+    if (event == EVENT_TIMER_EXPIRE) {
+        if (!phase) {
+            return enter_phase(fsm, fsm->program.entry); // first phase of a new program
+        }
+        if (phase->flags & MYTRAFFIC_PHASE_WALK) {
+            fsm->pedestrian_present = false; // pedestrians have crossed
+        }
+        return enter_phase(fsm, fsm->pedestrian_present && phase->ped_next != MYTRAFFIC_PHASE_NONE ? phase->ped_next : phase->next);
+    }
+
+    // pedestrian call: go straight to the crossing if the current phase leads to it, otherwise wait for the phase to end
+    fsm->pedestrian_present = true;
+    if (phase && phase->ped_next != MYTRAFFIC_PHASE_NONE) {
+        return enter_phase(fsm, phase->ped_next);
+    }
+    return false;
+}
+
+// a vehicle arrived: keep an actuated phase going for the passage time, up to its maximum
+static bool handle_detector(traffic_fsm_t *fsm, s64 time) {
+    const struct mytraffic_phase *phase;
+    s64 extended;
+
+    if ((fsm->mode != NORMAL_MODE && fsm->mode != PEDESTRIAN_MODE) || fsm->phase >= fsm->program.num_phases) {
+        return false;
+    }
+    phase = &fsm->program.phases[fsm->phase];
+    if (!(phase->flags & MYTRAFFIC_PHASE_ACTUATED)) {
+        return false;
+    }
+
+    extended = time + phase_ns(fsm, phase, phase->gap);
+    if (extended > fsm->max_deadline) {
+        extended = fsm->max_deadline; // max-out
+    }
+    if (extended <= fsm->deadline) {
+        return false;
+    }
+    fsm->deadline = extended;
+    fsm->natural_deadline = extended;
+    return true;
+}
+
+static bool handle_flashing_red(traffic_fsm_t *fsm) {
+    fsm->status ^= LIGHT_RED; // toggle red light
+    fsm->status &= ~(LIGHT_YELLOW | LIGHT_GREEN);
+    schedule_phase(fsm, 1);
+    return true;
+}
+
+static bool handle_flashing_yellow(traffic_fsm_t *fsm) {
+    fsm->status ^= LIGHT_YELLOW; // toggle yellow light
+    fsm->status &= ~(LIGHT_RED | LIGHT_GREEN);
+    schedule_phase(fsm, 1);
+    return true;
+}
+
+static bool handle_lightbulb_check(traffic_fsm_t *fsm, unsigned int buttons) {
+    // turn on all lights for lightbulb check
+    fsm->status = LIGHT_ALL;
+    if (!(buttons & (BTN_0_DOWN | BTN_1_DOWN))) { // if both buttons are released
+        set_cycle_rate(fsm, 1000); // reset cycle rate to 1 Hz
+        return enter_phase(fsm, fsm->program.entry); // reset to normal mode
+    }
+    // nothing timed until the release event
+    if (fsm->deadline == MYTRAFFIC_NO_DEADLINE) {
+        return false;
+    }
+    fsm->deadline = MYTRAFFIC_NO_DEADLINE;
+    fsm->natural_deadline = MYTRAFFIC_NO_DEADLINE;
+    return true;
+}
+
+void traffic_fsm_init(traffic_fsm_t *fsm, s64 now) {
+    fsm->program = default_program;
+    fsm->coord.enabled = 0; // free running
+    set_cycle_rate(fsm, 1000); // default cycle rate (1 Hz)
+    fsm->pedestrian_present = false; // no pedestrian by default
+    fsm->phase_start = now;
+    enter_phase(fsm, 0); // start with red to trigger green
+}
+
+bool traffic_fsm_check_program(const struct mytraffic_program *program) {
+    unsigned int i;
+
+    if (program->num_phases < 1 || program->num_phases > MYTRAFFIC_MAX_PHASES || program->entry >= program->num_phases) {
+        return false;
+    }
+    for (i = 0; i < program->num_phases; i++) {
+        const struct mytraffic_phase *phase = &program->phases[i];
+
+        u32 limit = phase->flags & MYTRAFFIC_PHASE_MS ? MYTRAFFIC_MAX_MS : MYTRAFFIC_MAX_CYCLES;
+
+        if (phase->lamps & ~LIGHT_ALL ||
+            phase->flags & ~(MYTRAFFIC_PHASE_WALK | MYTRAFFIC_PHASE_ACTUATED | MYTRAFFIC_PHASE_MS) ||
+            phase->duration < 1 || phase->duration > limit || phase->next >= program->num_phases ||
+            (phase->flags & MYTRAFFIC_PHASE_ACTUATED && (phase->max_duration < phase->duration ||
+                phase->max_duration > limit || phase->gap < 1 || phase->gap > limit)) ||
+            (phase->ped_next != MYTRAFFIC_PHASE_NONE && phase->ped_next >= program->num_phases)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+void traffic_fsm_set_program(traffic_fsm_t *fsm, const struct mytraffic_program *program) {
+    fsm->program = *program;
+    fsm->phase = MYTRAFFIC_PHASE_NONE; // phase numbers of the old program mean nothing now
+}
+
+// remaining time of a phase, converted from the old to the new cycle rate
+static s64 rescale(s64 end, s64 now, u32 old_rate, u32 new_rate) {
+    return now + div_u64((u64)(end - now) * old_rate, new_rate);
+}
+
+bool traffic_fsm_set_rate(traffic_fsm_t *fsm, u32 cycle_rate_mhz, s64 now) {
+    u32 old_rate = fsm->cycle_rate_mhz;
+
+    set_cycle_rate(fsm, cycle_rate_mhz);
+    if (cycle_rate_mhz == old_rate || fsm->deadline == MYTRAFFIC_NO_DEADLINE || fsm->deadline <= now) {
+        return false; // nothing timed, or the expiry is already on its way
+    }
+    if (!fsm->cycle_timed) {
+        return false; // timed in ms, not cycles
+    }
+
+    // keep the elapsed part of the phase, play the rest at the new rate; a stretch onto the grid is not
+    // part of the phase, so only the natural end is rescaled (unless the phase is already in its stretch)
+    if (fsm->natural_deadline > now) {
+        fsm->natural_deadline = rescale(fsm->natural_deadline, now, old_rate, cycle_rate_mhz);
+    }
+    if (fsm->max_deadline > now) {
+        fsm->max_deadline = rescale(fsm->max_deadline, now, old_rate, cycle_rate_mhz);
+    }
+
+    // a coordinated light still ends the phase before its entry phase on the common grid
+    fsm->deadline = fsm->on_grid && fsm->coord.enabled ?
+        next_sync_point(&fsm->coord, fsm->natural_deadline) : fsm->natural_deadline;
+    return true;
+}
+
+void traffic_fsm_actuate_entry(traffic_fsm_t *fsm, unsigned int min_cycles, unsigned int gap_cycles, unsigned int max_cycles) {
+    struct mytraffic_phase *phase = &fsm->program.phases[fsm->program.entry];
+
+    phase->flags |= MYTRAFFIC_PHASE_ACTUATED;
+    phase->flags &= ~MYTRAFFIC_PHASE_MS;
+    phase->duration = min_cycles;
+    phase->gap = gap_cycles;
+    phase->max_duration = max_cycles;
+}
+
+bool traffic_fsm_check_coord(const struct mytraffic_coord *coord) {
+    // bounded so epoch + offset + k * cycle around any monotonic time stays within s64
+    return !coord->enabled || (coord->cycle_ns > 0 && coord->cycle_ns <= MYTRAFFIC_MAX_COORD_CYCLE_NS &&
+        coord->offset_ns > -coord->cycle_ns && coord->offset_ns < coord->cycle_ns &&
+        coord->epoch_ns >= -MYTRAFFIC_MAX_COORD_EPOCH_NS && coord->epoch_ns <= MYTRAFFIC_MAX_COORD_EPOCH_NS);
+}
+
+void traffic_fsm_set_coord(traffic_fsm_t *fsm, const struct mytraffic_coord *coord) {
+    fsm->coord = *coord;
+}
+
+void traffic_fsm_save(const traffic_fsm_t *fsm, struct mytraffic_fsm_state *state) {
+    memset(state, 0, sizeof(*state));
+    state->phase_start_ns = fsm->phase_start;
+    state->deadline_ns = fsm->deadline;
+    state->max_deadline_ns = fsm->max_deadline;
+    state->natural_deadline_ns = fsm->natural_deadline;
+    state->mode = fsm->mode;
+    state->lamps = fsm->status;
+    state->cycle_rate_mhz = fsm->cycle_rate_mhz;
+    state->pedestrian_present = fsm->pedestrian_present;
+    state->phase = fsm->phase;
+    state->flags = (fsm->cycle_timed ? MYTRAFFIC_FSM_CYCLE_TIMED : 0) | (fsm->on_grid ? MYTRAFFIC_FSM_ON_GRID : 0);
+    state->program = fsm->program;
+    state->coord = fsm->coord;
+}
+
+bool traffic_fsm_restore(traffic_fsm_t *fsm, const struct mytraffic_fsm_state *state) {
+    if (state->mode >= NUM_MODES || state->lamps & ~LIGHT_ALL ||
+        state->cycle_rate_mhz < MYTRAFFIC_MIN_RATE_MHZ || state->cycle_rate_mhz > MYTRAFFIC_MAX_RATE_MHZ ||
+        !traffic_fsm_check_program(&state->program) || !traffic_fsm_check_coord(&state->coord) ||
+        (state->phase >= state->program.num_phases && state->phase != MYTRAFFIC_PHASE_NONE) ||
+        state->flags & ~(MYTRAFFIC_FSM_CYCLE_TIMED | MYTRAFFIC_FSM_ON_GRID)) {
+        return false;
+    }
+    fsm->phase_start = state->phase_start_ns;
+    fsm->deadline = state->deadline_ns;
+    fsm->max_deadline = state->max_deadline_ns;
+    fsm->natural_deadline = state->natural_deadline_ns;
+    fsm->mode = state->mode;
+    fsm->status = state->lamps;
+    set_cycle_rate(fsm, state->cycle_rate_mhz);
+    fsm->pedestrian_present = state->pedestrian_present;
+    fsm->phase = state->phase;
+    fsm->cycle_timed = state->flags & MYTRAFFIC_FSM_CYCLE_TIMED;
+    fsm->on_grid = state->flags & MYTRAFFIC_FSM_ON_GRID;
+    fsm->program = state->program;
+    fsm->coord = state->coord;
+    return true;
+}
+
+bool traffic_fsm_handle_event(traffic_fsm_t *fsm, event_t event, s64 time, unsigned int buttons) {
+    opmode_t prev_mode = fsm->mode;
+    opmode_t next_mode = state_transition_table[event][prev_mode]; // get next mode based on current mode and event
+
+    if (event == EVENT_DETECTOR) {
+        return handle_detector(fsm, time); // the current phase keeps its start
+    }
+    if (event == EVENT_BTN_RELEASE && fsm->mode != LIGHTBULB_CHECK) {
+        return false;
+    }
+
+    // a phase ended by the timer starts exactly at the expired deadline, a button restarts timing from the press
+    fsm->phase_start = time;
+    fsm->mode = next_mode; // update mode, the phase program may refine it
+
+    if (event == EVENT_BTN_1_PRESS && (fsm->mode == FLASHING_RED || fsm->mode == FLASHING_YELLOW)) {
+        // if pedestrian button is pressed while in flashing mode, don't do anything (don't call handler again) to prevent light jittering
+        return false;
+    }
+
+    switch (next_mode) {
+        case NORMAL_MODE:
+        case PEDESTRIAN_MODE:
+            return handle_program(fsm, event, prev_mode);
+        case FLASHING_RED:
+            return handle_flashing_red(fsm);
+        case FLASHING_YELLOW:
+            return handle_flashing_yellow(fsm);
+        case LIGHTBULB_CHECK:
+            fsm->pedestrian_present = false; // clear pedestrian present flag
+            return handle_lightbulb_check(fsm, buttons);
+    }
+    return false;
+}
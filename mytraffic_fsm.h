@@ -0,0 +1,121 @@
+/*
+	Traffic light state machine core
+
+	Pure logic shared by the kernel module and the user-space library in tools/:
+		- Inputs: an event (button press/release, timer or vehicle detector), the time it happened
+		  (ns, CLOCK_MONOTONIC in the module) and which buttons are held after it
+		- Outputs: the lamp bitmask and the deadline of the current phase (MYTRAFFIC_NO_DEADLINE while
+		  only a button release can end it, e.g. lightbulb check)
+		- Normal and pedestrian mode are driven by a phase program (struct mytraffic_program in
+		  mytraffic.h), a table of lamp masks, durations and successors stepped by one generic engine
+		- Optionally coordinated (struct mytraffic_coord): the program's entry phase starts on a common
+		  cycle grid shared with other lights
+		- No timers, GPIOs or locking: the caller arms its timer for the new deadline when
+		  traffic_fsm_handle_event() returns true, and drives the lamps from status
+
+*/
+
+#ifndef MYTRAFFIC_FSM_H
+#define MYTRAFFIC_FSM_H
+
+#ifdef __KERNEL__
+#include <linux/types.h>
+#include <linux/time64.h>		// NSEC_PER_SEC
+#else
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+typedef int64_t s64;
+typedef uint64_t u64;
+typedef uint32_t u32;
+
+#define NSEC_PER_MSEC 1000000L
+#define NSEC_PER_SEC 1000000000L
+#endif
+
+#include "mytraffic.h"
+
+typedef enum {
+    NORMAL_MODE,
+    FLASHING_RED,
+    FLASHING_YELLOW,
+    PEDESTRIAN_MODE,
+    LIGHTBULB_CHECK
+} opmode_t;
+#define NUM_MODES (LIGHTBULB_CHECK + 1)
+
+typedef enum {
+    EVENT_BTN_0_PRESS,
+    EVENT_BTN_1_PRESS,
+    EVENT_BOTH_BTNS_PRESS,
+    EVENT_TIMER_EXPIRE,
+    EVENT_DETECTOR,
+    EVENT_BTN_RELEASE
+} event_t;
+#define NUM_EVENTS (EVENT_BTN_RELEASE + 1)
+
+// light status: bit set = lamp on, same order as the module's lamp pins (red, yellow, green)
+#define LIGHT_RED ((unsigned long)MYTRAFFIC_LAMP_RED)
+#define LIGHT_YELLOW ((unsigned long)MYTRAFFIC_LAMP_YELLOW)
+#define LIGHT_GREEN ((unsigned long)MYTRAFFIC_LAMP_GREEN)
+#define LIGHT_ALL (LIGHT_RED | LIGHT_YELLOW | LIGHT_GREEN)
+typedef unsigned long light_status_t;
+
+// buttons held down when the event is handled
+#define BTN_0_DOWN (1U << 0)
+#define BTN_1_DOWN (1U << 1)
+
+typedef struct {
+    opmode_t mode; // current operational mode
+    light_status_t status; // current status of each light
+    u32 cycle_rate_mhz; // in mHz
+    u64 cycle_ns; // length of one cycle at cycle_rate_mhz, so durations need no division
+    bool pedestrian_present;
+    s64 phase_start; // start of the current phase (ns)
+    s64 deadline; // absolute end of the current phase (ns)
+    s64 max_deadline; // latest end of an actuated phase (ns)
+    s64 natural_deadline; // end of the current phase before any stretch onto the coordination grid (ns)
+    unsigned int phase; // current phase of the program, MYTRAFFIC_PHASE_NONE after a new program was set
+    bool cycle_timed; // the current phase lasts cycles, so rate changes rescale it (not ms phases)
+    bool on_grid; // the current phase was stretched to end on the coordination grid
+    struct mytraffic_program program; // phases of normal and pedestrian mode
+    struct mytraffic_coord coord; // common cycle the entry phase is aligned to, if enabled
+} traffic_fsm_t;
+
+extern const char *const mode_names[NUM_MODES];
+extern const char *const event_names[NUM_EVENTS];
+extern opmode_t state_transition_table[NUM_EVENTS][NUM_MODES]; // next mode by event and current mode
+
+// load the default program and start its phase 0 (red for 2 cycles) at `now`, normal mode at 1 Hz (1000 mHz)
+void traffic_fsm_init(traffic_fsm_t *fsm, s64 now);
+
+// true if every phase of the program has a valid successor, lamps and duration
+bool traffic_fsm_check_program(const struct mytraffic_program *program);
+
+// replace the program (already checked), the current phase runs to its deadline
+void traffic_fsm_set_program(traffic_fsm_t *fsm, const struct mytraffic_program *program);
+
+// change the cycle rate at `now`: the rest of the current phase is rescaled to the new rate,
+// returns true if the deadline moved (re-arm the timer)
+bool traffic_fsm_set_rate(traffic_fsm_t *fsm, u32 cycle_rate_mhz, s64 now);
+
+// make the program's entry phase actuated (min/max green and passage time in cycles)
+void traffic_fsm_actuate_entry(traffic_fsm_t *fsm, unsigned int min_cycles, unsigned int gap_cycles, unsigned int max_cycles);
+
+// true if the coordination setting is usable (disabled, or cycle, offset and epoch within the limits of mytraffic.h)
+bool traffic_fsm_check_coord(const struct mytraffic_coord *coord);
+
+// set the common cycle, takes effect from the next phase
+void traffic_fsm_set_coord(traffic_fsm_t *fsm, const struct mytraffic_coord *coord);
+
+// copy the whole state out, e.g. to start a recording
+void traffic_fsm_save(const traffic_fsm_t *fsm, struct mytraffic_fsm_state *state);
+
+// continue from a saved state, false (fsm unchanged) if it is not a valid state
+bool traffic_fsm_restore(traffic_fsm_t *fsm, const struct mytraffic_fsm_state *state);
+
+// apply one event, returns true if the deadline changed (re-arm the timer for fsm->deadline, or stop it)
+bool traffic_fsm_handle_event(traffic_fsm_t *fsm, event_t event, s64 time, unsigned int buttons);
+
+#endif
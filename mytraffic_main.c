@@ -0,0 +1,2028 @@
+/*
+	3 Operational Modes:
+		1. Normal Mode: 
+			- Green for 3 cycless
+			- Yellow for 1 cycle
+			- Red for 2 cycles
+		2. Flashing Red
+			- Red for 1 cycle
+			- Off for 1 cycle
+		3. Flashing Yellow
+			- Yellow for 1 cycle
+			- Off for 1 cycle
+
+	Multiple intersections:
+		- num_lights=N module parameter creates N independent traffic lights
+		- Each light has its own timer, IRQs and GPIO set, and is exposed as character device (61, N) at /dev/mytrafficN
+
+	Phase timing:
+		- Phases are timed by a high resolution timer against absolute deadlines
+		- A phase ended by the timer starts exactly at the previous deadline, so callback latency never accumulates
+
+	State machine core (mytraffic_fsm.c):
+		- Mode/lamp logic and phase deadlines are computed by a pure core without timers or GPIOs,
+		  also built into a user-space library (tools/) for off-target tests and benchmarks
+		- The module feeds it events, arms the hrtimer for the deadline it returns and drives the lamps
+
+	Event handling:
+		- Button IRQs and the phase timer only timestamp the event and queue it on the light's event queue
+		- A single real-time kernel thread drains the queues and runs the state machine, one event at a time
+		- After every change the worker publishes a snapshot of the state under a seqcount, readers copy it
+		  without taking any lock and retry if it changed meanwhile, so they never block the worker or see a torn state
+		- The status text is rendered once per change along with the snapshot, reads only copy it out
+		  and skip even that if their copy is still current
+
+	Read from character device (61, N) at /dev/mytrafficN:
+		- Current mode
+		- Current cycle rate (Hz)
+		- Current status of each light (Red off, Yellow off, Green on)
+		- Pedestrian present? (Currently crossing/waiting to cross after pressing cross button)
+		- Timer lateness (last/max time between a phase deadline and the timer firing) and number of timer fires
+
+	Waiting for changes:
+		- The first read (and any read at offset 0, e.g. pread) returns the current status immediately
+		- Once a status has been read completely, further reads block until the mode, lamps, rate or
+		  pedestrian flag change and then return the new status (O_NONBLOCK: fail with EAGAIN instead)
+		- poll/epoll report the device readable while there is a status the reader has not seen yet
+
+	Binary status (see mytraffic.h):
+		- MYTRAFFIC_IOC_GET_STATUS ioctl returns the state as a packed, versioned struct mytraffic_status
+		- MYTRAFFIC_IOC_SET_FORMAT ioctl switches reads on that file to struct mytraffic_status records
+
+	Phase program (see mytraffic.h):
+		- Normal/pedestrian mode timing is a table of phases (lamps, cycles or ms, next phase, next phase
+		  when a pedestrian waits), by default the 2 red / 3 green / 1 yellow / 5 red+yellow cycle below
+		- MYTRAFFIC_IOC_SET_PROGRAM / MYTRAFFIC_IOC_GET_PROGRAM ioctls replace/return it per light
+
+	Coordination (see mytraffic.h, tools/mytraffic_coord):
+		- MYTRAFFIC_IOC_SET_COORD locks a light to a common cycle (epoch, cycle length) with its own offset:
+		  the phase before the program's entry phase is stretched so green starts on the shared grid
+
+	Transition log (debugfs, see mytraffic.h):
+		- /sys/kernel/debug/mytraffic/N/log: every handled event (event, previous/next mode, lamps, time)
+		- /sys/kernel/debug/mytraffic/N/log_overflows: entries dropped because the log was full
+
+	Input recording (debugfs, see mytraffic.h):
+		- /sys/kernel/debug/mytraffic/N/record: while open, every input of the state machine (handled
+		  events, rate writes, program and coordination changes) with the outputs it produced,
+		  after the full state at the time of opening
+		- record_kb=K sets the buffer of a recording (default 64 KiB), tools/mytraffic_replay replays it
+
+	Event storm (make STORM=1 only, debugfs):
+		- Stress test for the event path: per-CPU threads queue synthetic events on one light the way
+		  the IRQ handlers do, e.g. a detector stuck toggling or buttons chattering
+		- /sys/kernel/debug/mytraffic/storm/: light, event (MYTRAFFIC_EVENT_*), rate (events/s per
+		  CPU), cpus and ms set the storm, writing run starts it and returns once it is over
+		- Timer expiries are not stormed: only the phase timer raises them, and they would count as
+		  timer fires in the lateness statistics
+		- Reading run reports events sent, handled and dropped and the worst queue-to-handler latency
+
+	Counters (debugfs):
+		- /sys/kernel/debug/mytraffic/N/counters: events queued by type, transitions (event and the
+		  mode it arrived in, one per state_transition_table cell), debounce rejections, timer fires
+		  and lamp GPIO writes
+		- Kept per CPU, so IRQs, timers and the worker on different cores never share a counter
+		  cache line; the file sums them over all CPUs when read
+
+	Latency histograms (debugfs):
+		- /sys/kernel/debug/mytraffic/N/histograms: per mode log2 histograms of timer lateness and
+		  handle_event() execution time, with count, min, max and p50/p90/p99 (bucket upper bounds)
+		- Write anything to the file to reset the histograms
+
+	Status of all lights (/proc/mytraffic):
+		- One line per light: index, mode, lamps (e.g. "R-G"), cycle rate (Hz), time left in the
+		  phase (ms, "-" while waiting for a release), state changes, timer fires, dropped events,
+		  detector calls and log overflows
+		- Streamed with seq_file one light at a time, so it stays cheap for any number of lights
+
+	Tracing (see mytraffic_trace.h):
+		- mytraffic:mytraffic_event, _transition, _lamps, _irq and _timer tracepoints for ftrace/perf
+
+	Memory map the character device:
+		- A read-only page with a versioned binary status (struct mytraffic_shared in mytraffic.h),
+		  updated by the kernel on every transition so pollers need no system calls
+
+	Write to character device:
+		- Write a rate in Hz (0.001-9, up to 3 decimals) sets the cycle rate, kept in mHz
+			- Ex: echo 2 > /dev/mytraffic0 sets cycle rate to 2 Hz, so each cycle is 0.5 seconds
+			- Ex: echo 0.25 > /dev/mytraffic0 makes each cycle 4 seconds
+		- Takes effect at once: the rest of the current phase is rescaled (1 -> 2 Hz halves what is left)
+		- Ignore any other data written
+
+	Vehicle detectors (actuated green):
+		- detectors_per_light=K detectors=g,g,... adds K detector inputs (loop/presence) per light,
+		  listed light by light; a rising edge is one vehicle call
+		- With detectors, green is actuated: at least 1 cycle, extended to 1 cycle after each call
+		  (gap-out when traffic stops) but never beyond 6 cycles (max-out); other timings via the program ioctl
+		- /sys/kernel/debug/mytraffic/N/detector_calls counts the calls
+
+	Pedestrian Call Button (BTN_1):
+		- For normal mode
+		- At the next stop phase (red), turn on both red and yellow for 5 cycles instead of red for 2 cycles
+		- Return to normal after 
+
+	Lightbulb check feature:
+		- Hold both buttons: ON all lights
+		- Release: Reset to initial state (normal mode, 1 Hz cycle rate, 3 cycles green, no pedestrians)
+		- Buttons interrupt on both edges and their held state is tracked with the events, so the
+		  release is an event too: no timer runs while the buttons are held
+
+	Button debounce:
+		- debounce_ms=b0,b1 sets the window per button (default 50 ms, 0 = off)
+		- If the GPIO controller can debounce (gpiod_set_debounce), it does and every edge is taken
+		- Otherwise each edge restarts a window timer, and the level is sampled once the line has been
+		  quiet for the window; a press is timestamped with the first edge of its burst
+		- The IRQ and the window timer only timestamp; the level is read by the event worker, so
+		  buttons may sit on GPIO controllers that sleep (I2C expanders, gpio-sim)
+		- /sys/kernel/debug/mytraffic/N/debounce: mode, window, edges, rejected bounces, accepted changes
+
+*/
+
+/*
+	Building:
+		- make: cross-build for the BeagleBone kernel (4.19.82-ti-rt)
+		- make host: build against the running kernel, e.g. an x86 VM with tools/mytraffic_sim.sh
+		  providing simulated lamps and buttons through gpio-sim
+
+	GPIO Pins (default for /dev/mytraffic0):
+		Red light: 67
+		Yellow light: 68
+		Green light: 44
+		Button 0: 26
+		Button 1: 46
+		
+	Other instances:
+		- pins=r,y,g,b0,b1[,r,y,g,b0,b1...] sets the GPIOs of the first lights explicitly
+		- Remaining lights take consecutive blocks of 5 lines (same order) starting at gpio_base,
+		  e.g. a single gpio-sim bank of 5 * N lines
+
+*/
+
+#include <linux/module.h>
+#include <linux/kernel.h>
+#include <linux/hrtimer.h>
+#include <linux/ktime.h>
+#include <linux/math64.h>		// div_u64
+#include <linux/version.h>
+#include <linux/fs.h>			// filesystem operations
+#include <linux/uaccess.h>		// copy_to/from_user
+#include <linux/gpio.h>
+#include <linux/gpio/consumer.h>	// gpio descriptors
+#include <linux/cdev.h>
+#include <linux/device.h>
+#include <linux/interrupt.h>
+#include <linux/mm.h>			// kvcalloc/kvfree
+#include <linux/kfifo.h>
+#include <linux/kthread.h>
+#include <linux/mutex.h>
+#include <linux/spinlock.h>
+#include <linux/seqlock.h>
+#include <linux/sched.h>
+#include <uapi/linux/sched/types.h>	// struct sched_param
+#include <linux/io.h>			// virt_to_phys
+#include <linux/wait.h>
+#include <linux/poll.h>
+#include <linux/slab.h>
+#include <linux/debugfs.h>
+#include <linux/seq_file.h>
+#include <linux/proc_fs.h>
+#include <linux/bitops.h>		// fls64
+#include <linux/ctype.h>		// isdigit
+#include <linux/string.h>		// skip_spaces
+#include <linux/delay.h>		// msleep, usleep_range
+#include <linux/cpumask.h>		// for_each_online_cpu
+#include <linux/percpu.h>		// alloc_percpu, this_cpu_inc
+
+#include "mytraffic.h"
+#include "mytraffic_fsm.h"
+
+#define CREATE_TRACE_POINTS
+#include "mytraffic_trace.h"
+
+MODULE_LICENSE("Dual BSD/GPL");
+MODULE_LICENSE("GPL");
+MODULE_DESCRIPTION("Traffic light kernel module");
+
+#define RED 67
+#define YELLOW 68
+#define GREEN 44
+#define BTN_0 26	// Mode switch button
+#define BTN_1 46	// Pedestrian call button
+#define MYTRAFFIC_MAJOR 61
+#define MYTRAFFIC_MAX_LIGHTS 4096	// minors 0..4095
+#define MYTRAFFIC_MAX_PIN_SETS 16	// lights configurable through the pins parameter
+#define MYTRAFFIC_MAX_DETECTORS 4	// vehicle detectors per light
+#define ACTUATED_MIN_GREEN 1	// cycles of green without vehicle calls
+#define ACTUATED_GAP 1	// cycles of green after each vehicle call
+#define ACTUATED_MAX_GREEN 6	// longest green under continuous demand
+#define MYTRAFFIC_EVENT_QUEUE_LEN 16	// events per light, power of 2
+#define MYTRAFFIC_STATUS_LEN 256	// longest status text
+#define HIST_BUCKETS 32	// bucket 0: <= 0 ns, bucket n: [2^(n-1), 2^n) ns, last bucket: everything above
+
+// expire phase timers in hard interrupt context on -rt kernels instead of the softirq thread
+#if defined(CONFIG_PREEMPT_RT_FULL) || LINUX_VERSION_CODE >= KERNEL_VERSION(5, 4, 0)
+#define MYTRAFFIC_HRTIMER_MODE HRTIMER_MODE_ABS_HARD
+#define MYTRAFFIC_DEBOUNCE_MODE HRTIMER_MODE_REL_HARD
+#else
+#define MYTRAFFIC_HRTIMER_MODE HRTIMER_MODE_ABS
+#define MYTRAFFIC_DEBOUNCE_MODE HRTIMER_MODE_REL
+#endif
+
+// kernel API changes, so the module also builds against current host kernels (make host)
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 4, 0)
+#define mytraffic_class_create(name) class_create(name)
+#else
+#define mytraffic_class_create(name) class_create(THIS_MODULE, name)
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 13, 0)
+#define mytraffic_hrtimer_setup(timer, fn, mode) hrtimer_setup(timer, fn, CLOCK_MONOTONIC, mode)
+#else
+#define mytraffic_hrtimer_setup(timer, fn, mode) \
+    do { hrtimer_init(timer, CLOCK_MONOTONIC, mode); (timer)->function = fn; } while (0)
+#endif
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 14, 0)
+#define mytraffic_create_worker(name) kthread_run_worker(0, name) // kthread_create_worker() no longer starts it
+#else
+#define mytraffic_create_worker(name) kthread_create_worker(0, name)
+#endif
+
+/* ======================= Module parameters ======================= */
+typedef enum {
+    PIN_RED,
+    PIN_YELLOW,
+    PIN_GREEN,
+    PIN_BTN_0,
+    PIN_BTN_1,
+    NUM_PINS
+} pin_t;
+
+static unsigned int num_lights = 1;
+module_param(num_lights, uint, 0444);
+MODULE_PARM_DESC(num_lights, "Number of traffic lights (/dev/mytraffic0 .. /dev/mytrafficN-1)");
+
+static int pins[MYTRAFFIC_MAX_PIN_SETS * NUM_PINS] = { RED, YELLOW, GREEN, BTN_0, BTN_1 };
+static int num_pins = NUM_PINS;
+module_param_array(pins, int, &num_pins, 0444);
+MODULE_PARM_DESC(pins, "GPIOs of the first lights, 5 per light: red,yellow,green,btn0,btn1");
+
+static int gpio_base = -1;
+module_param(gpio_base, int, 0444);
+MODULE_PARM_DESC(gpio_base, "First GPIO of a contiguous block (5 per light) for lights not listed in pins");
+
+static unsigned int debounce_ms[2] = { 50, 50 };
+static int num_debounce_ms = 2;
+module_param_array(debounce_ms, uint, &num_debounce_ms, 0444);
+MODULE_PARM_DESC(debounce_ms, "Debounce window of btn0,btn1 in ms (0: off)");
+
+static unsigned int log_entries = 64;
+module_param(log_entries, uint, 0444);
+MODULE_PARM_DESC(log_entries, "Transition log entries per light (rounded up to a power of 2)");
+
+static unsigned int record_kb = 64;
+module_param(record_kb, uint, 0444);
+MODULE_PARM_DESC(record_kb, "Buffer of an input recording in KiB (rounded up to a power of 2)");
+
+static int detectors[MYTRAFFIC_MAX_PIN_SETS * MYTRAFFIC_MAX_DETECTORS];
+static int num_detector_gpios;
+module_param_array(detectors, int, &num_detector_gpios, 0444);
+MODULE_PARM_DESC(detectors, "Vehicle detector GPIOs, detectors_per_light per light");
+
+static unsigned int detectors_per_light;
+module_param(detectors_per_light, uint, 0444);
+MODULE_PARM_DESC(detectors_per_light, "Vehicle detectors per light (0-4), lights without listed detectors have fixed green");
+
+/* ======================= Global variables ======================= */
+typedef struct {
+    event_t type;
+    ktime_t time; // when the button was pressed, or the deadline that expired
+    ktime_t raised; // when the IRQ/timer queued the event
+    unsigned int buttons; // BTN_*_DOWN held after the event
+} queued_event_t;
+
+// light status (LIGHT_* in mytraffic_fsm.h): bit n drives the GPIO of pin n
+#define NUM_LAMPS PIN_BTN_0 // lamps are the pins before the buttons
+
+// log2 histogram of durations in ns
+typedef struct {
+    u32 buckets[HIST_BUCKETS];
+    u64 count;
+    s64 min;
+    s64 max;
+} histogram_t;
+
+// latency histograms of one light, indexed by mode
+typedef struct {
+    histogram_t lateness[NUM_MODES]; // timer lateness, by mode of the phase that ended
+    histogram_t handler[NUM_MODES]; // handle_event() execution time, by mode it switched to
+} light_histograms_t;
+
+// usage counters of one light, one copy per CPU, summed when read
+typedef struct {
+    u64 events[NUM_EVENTS]; // events queued, by type
+    u64 transitions[NUM_EVENTS][NUM_MODES]; // events handled, by type and the mode they arrived in
+    u64 debounce_rejects; // button edges taken as bounces
+    u64 timer_fires; // phase timer expiries
+    u64 gpio_writes; // lamp updates written to the GPIOs
+} light_counters_t;
+
+// consistent copy of the state for readers
+typedef struct {
+    opmode_t mode;
+    u32 cycle_rate_mhz;
+    light_status_t status;
+    bool pedestrian_present;
+    s64 last_lateness_ns;
+    s64 max_lateness_ns;
+    u64 timer_fires;
+    ktime_t deadline; // end of the current phase
+    ktime_t changed; // when mode, rate, lamps or pedestrian flag last changed
+    u32 generation; // bumped whenever mode, rate, lamps or pedestrian flag change
+} light_snapshot_t;
+
+// debounce of one button, updated under the light's event_lock
+typedef struct {
+    struct traffic_light *light;
+    unsigned int btn;
+    struct hrtimer settle; // software debounce: samples the level once edges stop for `window`
+    struct kthread_work sample; // reads the level on the event worker, the read may sleep
+    ktime_t window;
+    ktime_t first_edge; // first edge of the burst being settled
+    ktime_t sample_time; // timestamp for the change the queued sample finds
+    bool settling; // settle timer armed
+    bool sampling; // sample queued, later edges share its timestamp
+    bool hardware; // the GPIO controller debounces, edges are taken as they come
+    u64 edges; // IRQs seen
+    u64 bounces; // edges absorbed into a burst, or bursts that ended at the old level
+    u64 accepted; // presses and releases passed on
+} debounce_t;
+
+typedef struct traffic_light {
+    struct hrtimer timer; // timer for traffic light cycles, armed for fsm.deadline
+    traffic_fsm_t fsm; // mode, lamps, cycle rate and phase timing
+    s64 last_lateness_ns; // timer lateness measured at the last fire
+    s64 max_lateness_ns;
+    u64 timer_fires;
+    light_status_t output; // status last written to the lamp GPIOs
+    struct gpio_desc *lamps[NUM_LAMPS]; // lamp GPIO descriptors, written together as one array
+    unsigned int index; // minor number
+    int gpios[NUM_PINS]; // GPIO numbers, indexed by pin_t
+    unsigned int btn_0_irq; // IRQ number for button 0
+    unsigned int btn_1_irq; // IRQ number for button 1
+    debounce_t debounce[2]; // indexed by button
+    unsigned int buttons; // BTN_*_DOWN, updated by the button IRQs under event_lock
+    int detector_gpios[MYTRAFFIC_MAX_DETECTORS];
+    unsigned int detector_irqs[MYTRAFFIC_MAX_DETECTORS];
+    unsigned int num_detectors;
+    u64 detector_calls; // vehicle calls, counted in the IRQ path
+    DECLARE_KFIFO(events, queued_event_t, MYTRAFFIC_EVENT_QUEUE_LEN); // filled by IRQs/timer, drained by the event worker
+    raw_spinlock_t event_lock; // serializes producers, the worker consumes without locking
+    u64 events_dropped; // events lost because the queue was full
+    struct kthread_work event_work;
+    struct mutex lock; // protects the state machine (mode, status, cycle rate, timing)
+    bool stopping; // set on unload, the worker stops touching the light
+    seqcount_t snapshot_seq; // written under lock, read locklessly
+    light_snapshot_t snapshot;
+    char text[MYTRAFFIC_STATUS_LEN]; // snapshot rendered as status text, under snapshot_seq
+    size_t text_len;
+    u32 text_generation; // bumped whenever text is re-rendered
+    struct mytraffic_shared *shared; // page mapped read-only by user space
+    u32 generation; // latest snapshot generation, read locklessly by waiters
+    wait_queue_head_t wait; // readers waiting for the next change
+    DECLARE_KFIFO_PTR(log, struct mytraffic_log_entry); // transition log, filled by the event worker
+    struct mutex log_read_lock; // serializes log readers, the worker writes without locking
+    u64 log_overflows; // log entries dropped because the log was full
+    DECLARE_KFIFO_PTR(record, u8); // input recording, allocated while debugfs record is open
+    bool record_open; // under lock: debugfs record has its one opener
+    bool recording; // under lock: inputs are appended to record
+    bool record_lost; // the recording stopped because record was full
+    struct mutex record_read_lock; // serializes record readers, the worker writes without locking
+    wait_queue_head_t record_wait; // record readers waiting for data
+    struct dentry *debugfs_dir;
+    light_histograms_t *hist; // updated by the event worker under lock
+    light_counters_t __percpu *counters;
+#ifdef MYTRAFFIC_STORM
+    u64 storm_handled; // events taken off the queue, under lock
+    s64 storm_max_latency_ns; // longest time from queueing to handling, under lock
+#endif
+} traffic_light_t;
+
+static traffic_light_t *lights; // array of num_lights traffic lights, indexed by minor number
+static struct cdev mytraffic_cdev; // single cdev covering all minors
+static struct class *mytraffic_class;
+static struct kthread_worker *mytraffic_worker; // runs the state machine of every light
+static struct dentry *mytraffic_debugfs; // debugfs mytraffic/ directory
+static struct proc_dir_entry *mytraffic_proc; // /proc/mytraffic
+
+// per open file: the status being read and which state change it shows
+typedef struct {
+    traffic_light_t *light;
+    struct mutex lock; // serializes reads on this file
+    unsigned int format; // MYTRAFFIC_FORMAT_TEXT or MYTRAFFIC_FORMAT_BINARY
+    char buf[MYTRAFFIC_STATUS_LEN] __aligned(8); // text or struct mytraffic_status
+    size_t len; // length of the status in buf
+    size_t off; // how much of it has been read
+    u32 generation; // generation of the status in buf
+    u32 text_generation; // light's text_generation of the text in buf
+    bool loaded; // a status has been read at least once
+} reader_t;
+
+static const char *pin_names[NUM_PINS] = { "RED", "YELLOW", "GREEN", "BTN_0", "BTN_1" };
+
+/* ======================= Function Declarations/Definitions ======================= */
+static int gpio_init(traffic_light_t *light); // GPIO and IRQ initialization function
+static void gpio_irqs_exit(traffic_light_t *light); // IRQ and debounce release function
+static void gpio_exit(traffic_light_t *light); // GPIO release function, after gpio_irqs_exit
+void set_light_status(traffic_light_t *light); // helper function to set GPIOs based on light status
+
+// follow a new deadline of the state machine, called with light->lock held
+static void arm_timer(traffic_light_t *light) {
+    if (light->fsm.deadline == MYTRAFFIC_NO_DEADLINE) {
+        hrtimer_try_to_cancel(&light->timer); // a firing timer's event is dropped as stale
+    } else {
+        hrtimer_start(&light->timer, ns_to_ktime(light->fsm.deadline), MYTRAFFIC_HRTIMER_MODE);
+    }
+}
+
+// run the state machine on one event, then re-arm the timer and update the lamps
+static void handle_event(traffic_light_t *light, const queued_event_t *ev) {
+    if (traffic_fsm_handle_event(&light->fsm, ev->type, ktime_to_ns(ev->time), ev->buttons)) {
+        arm_timer(light);
+    }
+    set_light_status(light);
+}
+
+// mirror the state into the mmap()ed page, same odd/even protocol as a seqcount
+static void publish_shared(traffic_light_t *light) {
+    struct mytraffic_shared *shared = light->shared;
+
+    WRITE_ONCE(shared->seq, shared->seq + 1); // odd: update in progress
+    smp_wmb();
+    shared->mode = light->fsm.mode;
+    shared->cycle_rate = light->fsm.cycle_rate_mhz / 1000;
+    shared->cycle_rate_mhz = light->fsm.cycle_rate_mhz;
+    shared->lamps = light->fsm.status;
+    shared->pedestrian_present = light->fsm.pedestrian_present;
+    shared->deadline_ns = light->fsm.deadline;
+    smp_wmb();
+    WRITE_ONCE(shared->seq, shared->seq + 1);
+}
+
+// rate in Hz with only the decimals it needs: "1", "0.25"
+static int format_rate(char *buf, u32 mhz) {
+    u32 frac = mhz % 1000;
+    int digits = 3;
+
+    if (!frac) {
+        return sprintf(buf, "%u", mhz / 1000);
+    }
+    while (frac % 10 == 0) {
+        frac /= 10;
+        digits--;
+    }
+    return sprintf(buf, "%u.%0*u", mhz / 1000, digits, frac);
+}
+
+// render the current state as status text, returns its length
+static size_t render_status(traffic_light_t *light, char *buf) {
+    char *tbptr = buf;
+
+    // print current mode, cycle rate, light status, and pedestrian presence to kernel buffer
+    tbptr += sprintf(tbptr, "Operational mode: %s\n", mode_names[light->fsm.mode]);
+    tbptr += sprintf(tbptr, "Cycle rate: ");
+    tbptr += format_rate(tbptr, light->fsm.cycle_rate_mhz);
+    tbptr += sprintf(tbptr, " Hz\n");
+    tbptr += sprintf(tbptr, "Red status: %s\n", light->fsm.status & LIGHT_RED ? "on" : "off");
+    tbptr += sprintf(tbptr, "Yellow status: %s\n", light->fsm.status & LIGHT_YELLOW ? "on" : "off");
+    tbptr += sprintf(tbptr, "Green status: %s\n", light->fsm.status & LIGHT_GREEN ? "on" : "off");
+    tbptr += sprintf(tbptr, "Pedestrian present?: %s\n", light->fsm.pedestrian_present ? "yes" : "no");
+    tbptr += sprintf(tbptr, "Timer lateness: last %lld ns, max %lld ns, %llu fires\n",
+        light->last_lateness_ns, light->max_lateness_ns, light->timer_fires);
+
+    return tbptr - buf; // length of string in buffer
+}
+
+// publish the current state to lock-free readers, called with light->lock held after every change
+static void publish_snapshot(traffic_light_t *light) {
+    light_snapshot_t *snap = &light->snapshot;
+    bool changed = snap->mode != light->fsm.mode || snap->cycle_rate_mhz != light->fsm.cycle_rate_mhz ||
+        snap->status != light->fsm.status || snap->pedestrian_present != light->fsm.pedestrian_present;
+    // the text also shows the timer statistics, events that change nothing keep it as is
+    bool rerender = changed || snap->timer_fires != light->timer_fires || !light->text_len;
+    char text[MYTRAFFIC_STATUS_LEN];
+    size_t text_len = 0;
+
+    if (rerender) {
+        text_len = render_status(light, text); // outside the write section, readers only wait for the copy
+    }
+
+    preempt_disable(); // keep readers from spinning on a preempted writer
+    write_seqcount_begin(&light->snapshot_seq);
+    light->snapshot.mode = light->fsm.mode;
+    light->snapshot.cycle_rate_mhz = light->fsm.cycle_rate_mhz;
+    light->snapshot.status = light->fsm.status;
+    light->snapshot.pedestrian_present = light->fsm.pedestrian_present;
+    light->snapshot.last_lateness_ns = light->last_lateness_ns;
+    light->snapshot.max_lateness_ns = light->max_lateness_ns;
+    light->snapshot.timer_fires = light->timer_fires;
+    light->snapshot.deadline = ns_to_ktime(light->fsm.deadline);
+    if (changed) {
+        light->snapshot.changed = ktime_get();
+        light->snapshot.generation++;
+    }
+    if (rerender) {
+        memcpy(light->text, text, text_len);
+        light->text_len = text_len;
+        WRITE_ONCE(light->text_generation, light->text_generation + 1);
+    }
+    write_seqcount_end(&light->snapshot_seq);
+    preempt_enable();
+
+    publish_shared(light);
+
+    // timer statistics alone don't wake anyone
+    if (changed) {
+        WRITE_ONCE(light->generation, light->snapshot.generation);
+        wake_up_interruptible(&light->wait);
+    }
+}
+
+// copy the last published state, never blocks the worker
+static void read_snapshot(traffic_light_t *light, light_snapshot_t *snap) {
+    unsigned int seq;
+
+    do {
+        seq = read_seqcount_begin(&light->snapshot_seq);
+        *snap = light->snapshot;
+    } while (read_seqcount_retry(&light->snapshot_seq, seq));
+}
+
+static void hist_add(histogram_t *hist, s64 value) {
+    unsigned int bucket = value > 0 ? min_t(unsigned int, fls64(value), HIST_BUCKETS - 1) : 0;
+
+    hist->buckets[bucket]++;
+    if (!hist->count || value < hist->min) {
+        hist->min = value;
+    }
+    if (!hist->count || value > hist->max) {
+        hist->max = value;
+    }
+    hist->count++;
+}
+
+// upper bound (ns) of the bucket holding the pct-th percentile
+static s64 hist_percentile(const histogram_t *hist, unsigned int pct) {
+    u64 target = div_u64(hist->count * pct + 99, 100); // rank, rounded up
+    u64 seen = 0;
+    unsigned int b;
+
+    for (b = 0; b < HIST_BUCKETS - 1; b++) {
+        seen += hist->buckets[b];
+        if (seen >= target) {
+            return b ? 1LL << b : 0;
+        }
+    }
+    return hist->max; // overflow bucket
+}
+
+// account a timer fire `lateness` ns after its deadline, called with light->lock held
+static void record_timer_fire(traffic_light_t *light, s64 lateness) {
+    hist_add(&light->hist->lateness[light->fsm.mode], lateness);
+    light->last_lateness_ns = lateness;
+    if (lateness > light->max_lateness_ns) {
+        light->max_lateness_ns = lateness;
+    }
+    light->timer_fires++;
+    trace_mytraffic_timer(light->index, lateness);
+}
+
+// called from hard IRQ, timer or worker context: hand the timestamped event to the event worker
+static void queue_event(traffic_light_t *light, event_t event, ktime_t time) {
+    queued_event_t ev = { .type = event, .time = time, .raised = ktime_get() };
+    unsigned long flags;
+    bool queued;
+
+    raw_spin_lock_irqsave(&light->event_lock, flags);
+    ev.buttons = light->buttons;
+    queued = kfifo_put(&light->events, ev);
+    if (!queued) {
+        light->events_dropped++;
+    }
+    if (event == EVENT_DETECTOR) {
+        light->detector_calls++;
+    }
+    raw_spin_unlock_irqrestore(&light->event_lock, flags);
+    if (queued) {
+        this_cpu_inc(light->counters->events[event]); // drops are counted in events_dropped only
+    }
+    trace_mytraffic_event(light->index, event, queued);
+
+    kthread_queue_work(mytraffic_worker, &light->event_work);
+}
+
+// append a handled event to the transition log, called by the event worker only
+static void log_event(traffic_light_t *light, const queued_event_t *ev, opmode_t prev_mode) {
+    struct mytraffic_log_entry entry = {
+        .time_ns = ktime_to_ns(ev->time),
+        .event = ev->type,
+        .prev_mode = prev_mode,
+        .next_mode = light->fsm.mode,
+        .lamps = light->fsm.status,
+    };
+
+    if (!kfifo_put(&light->log, entry)) {
+        light->log_overflows++; // keep the oldest entries, drop the new one
+    }
+}
+
+// append an input of the state machine and the outputs it produced to the recording, called with lock held
+static void record_input(traffic_light_t *light, struct mytraffic_record *rec, const void *payload, size_t size) {
+    if (!light->recording) {
+        return;
+    }
+    rec->size = size;
+    rec->deadline_ns = light->fsm.deadline;
+    rec->mode = light->fsm.mode;
+    rec->lamps = light->fsm.status;
+    rec->pedestrian_present = light->fsm.pedestrian_present;
+
+    // records are kept whole: a gap would make the rest impossible to replay, so stop instead
+    if (kfifo_avail(&light->record) < sizeof(*rec) + size) {
+        light->recording = false;
+        WRITE_ONCE(light->record_lost, true);
+    } else {
+        kfifo_in(&light->record, (const u8 *)rec, sizeof(*rec));
+        if (size) {
+            kfifo_in(&light->record, (const u8 *)payload, size);
+        }
+    }
+    wake_up_interruptible(&light->record_wait);
+}
+
+// single consumer: apply queued events to the state machine in order
+static void mytraffic_event_work(struct kthread_work *work) {
+    traffic_light_t *light = container_of(work, traffic_light_t, event_work);
+    queued_event_t ev;
+    opmode_t prev_mode;
+    ktime_t handler_start;
+
+    mutex_lock(&light->lock);
+    while (kfifo_get(&light->events, &ev)) {
+        if (light->stopping) {
+            continue; // unloading, drop the event
+        }
+#ifdef MYTRAFFIC_STORM
+        light->storm_handled++;
+        light->storm_max_latency_ns = max_t(s64, light->storm_max_latency_ns,
+            ktime_to_ns(ktime_sub(ktime_get(), ev.raised)));
+#endif
+        if (ev.type == EVENT_TIMER_EXPIRE) {
+            record_timer_fire(light, ktime_to_ns(ktime_sub(ev.raised, ev.time)));
+            if (ktime_compare(ev.time, ns_to_ktime(light->fsm.deadline)) != 0) {
+                continue; // a button re-armed the timer after this expiry was queued
+            }
+        }
+        prev_mode = light->fsm.mode;
+        handler_start = ktime_get();
+        handle_event(light, &ev);
+        this_cpu_inc(light->counters->transitions[ev.type][prev_mode]);
+        hist_add(&light->hist->handler[light->fsm.mode], ktime_to_ns(ktime_sub(ktime_get(), handler_start)));
+        trace_mytraffic_transition(light->index, ev.type, prev_mode, light->fsm.mode);
+        log_event(light, &ev, prev_mode);
+        if (light->recording) {
+            struct mytraffic_record rec = {
+                .time_ns = ktime_to_ns(ev.time),
+                .type = MYTRAFFIC_REC_EVENT,
+                .event = ev.type,
+                .buttons = ev.buttons,
+            };
+
+            record_input(light, &rec, NULL, 0);
+        }
+        publish_snapshot(light);
+    }
+    mutex_unlock(&light->lock);
+}
+
+// called with event_lock held: take level `down` of button `btn`, true if it changed the held state
+static bool button_settle(traffic_light_t *light, unsigned int btn, bool down, event_t *event) {
+    unsigned int mask = btn ? BTN_1_DOWN : BTN_0_DOWN;
+
+    if (down == !!(light->buttons & mask)) {
+        return false;
+    }
+    if (down) {
+        light->buttons |= mask;
+        // both buttons held: lightbulb check
+        *event = light->buttons == (BTN_0_DOWN | BTN_1_DOWN) ? EVENT_BOTH_BTNS_PRESS :
+            btn ? EVENT_BTN_1_PRESS : EVENT_BTN_0_PRESS;
+    } else {
+        light->buttons &= ~mask;
+        *event = EVENT_BTN_RELEASE;
+    }
+    return true;
+}
+
+// called with event_lock held: count the outcome of a settled level
+static bool debounce_result(debounce_t *db, bool accepted) {
+    if (accepted) {
+        db->accepted++;
+    } else {
+        db->bounces++;
+        this_cpu_inc(db->light->counters->debounce_rejects);
+    }
+    trace_mytraffic_irq(db->light->index, db->btn, accepted);
+    return accepted;
+}
+
+// called with event_lock held: have the event worker read the level, stamped `time` unless a read is pending
+static void debounce_sample(debounce_t *db, ktime_t time) {
+    if (!db->sampling) {
+        db->sampling = true;
+        db->sample_time = time;
+    }
+    kthread_queue_work(mytraffic_worker, &db->sample);
+}
+
+// runs on the event worker: read the button level and queue the press or release it makes
+static void debounce_sample_work(struct kthread_work *work) {
+    debounce_t *db = container_of(work, debounce_t, sample);
+    traffic_light_t *light = db->light;
+    unsigned long flags;
+    ktime_t time;
+    event_t event;
+    bool down, accepted;
+
+    // an edge after this point queues another read
+    raw_spin_lock_irqsave(&light->event_lock, flags);
+    db->sampling = false;
+    time = db->sample_time;
+    raw_spin_unlock_irqrestore(&light->event_lock, flags);
+
+    down = gpio_get_value_cansleep(light->gpios[PIN_BTN_0 + db->btn]);
+
+    raw_spin_lock_irqsave(&light->event_lock, flags);
+    accepted = debounce_result(db, button_settle(light, db->btn, down, &event));
+    raw_spin_unlock_irqrestore(&light->event_lock, flags);
+
+    if (accepted) {
+        queue_event(light, event, time);
+    }
+}
+
+// software debounce: the line has been quiet for the window
+static enum hrtimer_restart debounce_timer_callback(struct hrtimer *t) {
+    debounce_t *db = container_of(t, debounce_t, settle);
+    unsigned long flags;
+
+    raw_spin_lock_irqsave(&db->light->event_lock, flags);
+    db->settling = false;
+    debounce_sample(db, db->first_edge);
+    raw_spin_unlock_irqrestore(&db->light->event_lock, flags);
+    return HRTIMER_NORESTART;
+}
+
+// both edges of button `btn`: timestamp and debounce, the worker reads the level
+static irqreturn_t button_irq(traffic_light_t *light, unsigned int btn) {
+    debounce_t *db = &light->debounce[btn];
+    ktime_t time = ktime_get();
+    unsigned long flags;
+
+    raw_spin_lock_irqsave(&light->event_lock, flags);
+    db->edges++;
+    if (db->hardware || !db->window) {
+        debounce_sample(db, time); // already clean
+    } else {
+        if (db->settling) {
+            db->bounces++; // still bouncing, restart the window
+            this_cpu_inc(light->counters->debounce_rejects);
+        } else {
+            db->settling = true;
+            db->first_edge = time;
+        }
+        hrtimer_start(&db->settle, db->window, MYTRAFFIC_DEBOUNCE_MODE);
+    }
+    raw_spin_unlock_irqrestore(&light->event_lock, flags);
+    return IRQ_HANDLED;
+}
+
+static irqreturn_t btn_0_irq_handler(int irq, void *dev_id) {
+    // handle mode switch button (BTN0)
+    return button_irq(dev_id, 0);
+}
+
+static irqreturn_t btn_1_irq_handler(int irq, void *dev_id) {
+    // handle pedestrian call button (BTN1)
+    return button_irq(dev_id, 1);
+}
+
+// vehicle detector: every rising edge is one call
+static irqreturn_t detector_irq_handler(int irq, void *dev_id) {
+    traffic_light_t *light = dev_id;
+
+    queue_event(light, EVENT_DETECTOR, ktime_get());
+    return IRQ_HANDLED;
+}
+
+static enum hrtimer_restart mytraffic_timer_callback(struct hrtimer *t) {
+    traffic_light_t *light = container_of(t, traffic_light_t, timer);
+
+    this_cpu_inc(light->counters->timer_fires);
+    // the worker measures lateness and re-arms the timer for the next phase
+    queue_event(light, EVENT_TIMER_EXPIRE, hrtimer_get_expires(t));
+    return HRTIMER_NORESTART;
+}
+
+static int mytraffic_open(struct inode *inode, struct file *filp) {
+    unsigned int minor = iminor(inode);
+    reader_t *reader;
+
+    if (minor >= num_lights) {
+        return -ENODEV;
+    }
+    reader = kzalloc(sizeof(reader_t), GFP_KERNEL);
+    if (!reader) {
+        return -ENOMEM;
+    }
+    reader->light = &lights[minor]; // reads/writes act on the light selected by the minor number
+    mutex_init(&reader->lock);
+    filp->private_data = reader;
+    return 0;
+}
+
+static int mytraffic_release(struct inode *inode, struct file *filp) {
+    kfree(filp->private_data);
+    return 0;
+}
+
+static traffic_light_t *file_light(struct file *filp) {
+    return ((reader_t *)filp->private_data)->light;
+}
+
+// convert a snapshot to the binary user-space layout
+static void fill_status(const light_snapshot_t *snap, struct mytraffic_status *status) {
+    memset(status, 0, sizeof(*status));
+    status->version = MYTRAFFIC_STATUS_VERSION;
+    status->size = sizeof(*status);
+    status->mode = snap->mode;
+    status->cycle_rate = snap->cycle_rate_mhz / 1000;
+    status->cycle_rate_mhz = snap->cycle_rate_mhz;
+    status->lamps = snap->status;
+    status->pedestrian_present = snap->pedestrian_present;
+    status->generation = snap->generation;
+    status->deadline_ns = ktime_to_ns(snap->deadline);
+    status->changed_ns = ktime_to_ns(snap->changed);
+    status->last_lateness_ns = snap->last_lateness_ns;
+    status->max_lateness_ns = snap->max_lateness_ns;
+    status->timer_fires = snap->timer_fires;
+}
+
+// copy the last published state into the reader's buffer
+static void load_status(reader_t *reader) {
+    traffic_light_t *light = reader->light;
+    light_snapshot_t snap;
+    unsigned int seq;
+
+    reader->off = 0;
+
+    if (reader->format == MYTRAFFIC_FORMAT_BINARY) {
+        read_snapshot(light, &snap);
+        reader->generation = snap.generation;
+        reader->loaded = true;
+        fill_status(&snap, (struct mytraffic_status *)reader->buf);
+        reader->len = sizeof(struct mytraffic_status);
+        return;
+    }
+
+    // the text in buf is still the one the worker last rendered
+    if (reader->loaded && reader->text_generation == READ_ONCE(light->text_generation)) {
+        return;
+    }
+
+    do {
+        seq = read_seqcount_begin(&light->snapshot_seq);
+        reader->generation = light->snapshot.generation;
+        reader->text_generation = light->text_generation;
+        reader->len = light->text_len;
+        memcpy(reader->buf, light->text, reader->len);
+    } while (read_seqcount_retry(&light->snapshot_seq, seq));
+    reader->loaded = true;
+}
+
+// true if the light changed since the reader's last status
+static bool status_changed(reader_t *reader) {
+    return !reader->loaded || READ_ONCE(reader->light->generation) != reader->generation;
+}
+
+static ssize_t mytraffic_read(struct file *filp, char *buf, size_t count, loff_t *f_pos) {
+    reader_t *reader = filp->private_data;
+    ssize_t result;
+
+    if (mutex_lock_interruptible(&reader->lock)) {
+        return -ERESTARTSYS;
+    }
+
+    if (*f_pos == 0) {
+        load_status(reader); // reading from the start always returns the current status
+    } else if (reader->off >= reader->len) {
+        // whole status read: wait for the next change, without the lock so ioctls on this file go ahead
+        while (reader->off >= reader->len && !status_changed(reader)) {
+            if (filp->f_flags & O_NONBLOCK) {
+                result = -EAGAIN;
+                goto out;
+            }
+            mutex_unlock(&reader->lock);
+            if (wait_event_interruptible(reader->light->wait, status_changed(reader))) {
+                return -ERESTARTSYS;
+            }
+            if (mutex_lock_interruptible(&reader->lock)) {
+                return -ERESTARTSYS;
+            }
+        }
+        if (reader->off >= reader->len) {
+            load_status(reader); // else another read on this file loaded it meanwhile
+        }
+    }
+
+    // binary records are only returned whole
+    if (reader->format == MYTRAFFIC_FORMAT_BINARY && count < reader->len - reader->off) {
+        result = -EINVAL;
+        goto out;
+    }
+
+    // limit count to prevent buffer overflows
+    if (count > reader->len - reader->off) {
+        count = reader->len - reader->off;
+    }
+
+    // copy to user, check for errors
+    if (copy_to_user(buf, reader->buf + reader->off, count)) {
+        result = -EFAULT;
+        goto out;
+    }
+
+    reader->off += count;
+    *f_pos += count; // increment file position
+    result = count;
+out:
+    mutex_unlock(&reader->lock);
+    return result;
+}
+
+static long mytraffic_ioctl(struct file *filp, unsigned int cmd, unsigned long arg) {
+    reader_t *reader = filp->private_data;
+    traffic_light_t *light = reader->light;
+    struct mytraffic_status status;
+    struct mytraffic_program program;
+    struct mytraffic_coord coord;
+    struct mytraffic_record rec = { 0 };
+    light_snapshot_t snap;
+
+    switch (cmd) {
+        case MYTRAFFIC_IOC_GET_STATUS:
+            read_snapshot(light, &snap);
+            fill_status(&snap, &status);
+            if (copy_to_user((void __user *)arg, &status, sizeof(status))) {
+                return -EFAULT;
+            }
+            return 0;
+        case MYTRAFFIC_IOC_SET_FORMAT:
+            if (arg != MYTRAFFIC_FORMAT_TEXT && arg != MYTRAFFIC_FORMAT_BINARY) {
+                return -EINVAL;
+            }
+            if (mutex_lock_interruptible(&reader->lock)) {
+                return -ERESTARTSYS;
+            }
+            reader->format = arg;
+            reader->loaded = false; // next read returns the current state in the new format
+            reader->off = reader->len = 0;
+            mutex_unlock(&reader->lock);
+            wake_up_interruptible(&light->wait); // including a read blocked on this file
+            return 0;
+        case MYTRAFFIC_IOC_SET_PROGRAM:
+            if (!(filp->f_mode & FMODE_WRITE)) {
+                return -EBADF; // changes the signal like a rate write, so needs write access too
+            }
+            if (copy_from_user(&program, (void __user *)arg, sizeof(program))) {
+                return -EFAULT;
+            }
+            if (!traffic_fsm_check_program(&program)) {
+                return -EINVAL;
+            }
+            mutex_lock(&light->lock);
+            traffic_fsm_set_program(&light->fsm, &program);
+            rec.type = MYTRAFFIC_REC_PROGRAM;
+            rec.time_ns = ktime_get_ns();
+            record_input(light, &rec, &program, sizeof(program));
+            mutex_unlock(&light->lock);
+            return 0;
+        case MYTRAFFIC_IOC_GET_PROGRAM:
+            mutex_lock(&light->lock);
+            program = light->fsm.program;
+            mutex_unlock(&light->lock);
+            if (copy_to_user((void __user *)arg, &program, sizeof(program))) {
+                return -EFAULT;
+            }
+            return 0;
+        case MYTRAFFIC_IOC_SET_COORD:
+            if (!(filp->f_mode & FMODE_WRITE)) {
+                return -EBADF;
+            }
+            if (copy_from_user(&coord, (void __user *)arg, sizeof(coord))) {
+                return -EFAULT;
+            }
+            if (!traffic_fsm_check_coord(&coord)) {
+                return -EINVAL;
+            }
+            mutex_lock(&light->lock);
+            traffic_fsm_set_coord(&light->fsm, &coord);
+            rec.type = MYTRAFFIC_REC_COORD;
+            rec.time_ns = ktime_get_ns();
+            record_input(light, &rec, &coord, sizeof(coord));
+            mutex_unlock(&light->lock);
+            return 0;
+        case MYTRAFFIC_IOC_GET_COORD:
+            mutex_lock(&light->lock);
+            coord = light->fsm.coord;
+            mutex_unlock(&light->lock);
+            if (copy_to_user((void __user *)arg, &coord, sizeof(coord))) {
+                return -EFAULT;
+            }
+            return 0;
+        default:
+            return -ENOTTY;
+    }
+}
+
+static __poll_t mytraffic_poll(struct file *filp, poll_table *wait) {
+    reader_t *reader = filp->private_data;
+
+    poll_wait(filp, &reader->light->wait, wait);
+    return status_changed(reader) ? EPOLLIN | EPOLLRDNORM : 0;
+}
+
+// parse a rate in Hz with up to 3 decimals ("2", "0.25") into mHz, integer math only
+static int parse_rate_mhz(const char *str, u32 *mhz) {
+    const char *p = skip_spaces(str);
+    u32 hz = 0, frac = 0, scale = 1000;
+
+    if (!isdigit(*p) && *p != '.') {
+        return -EINVAL;
+    }
+    while (isdigit(*p) && hz <= MYTRAFFIC_MAX_RATE_MHZ / 1000) {
+        hz = hz * 10 + (*p++ - '0');
+    }
+    if (*p == '.') {
+        for (p++; isdigit(*p); p++) {
+            if (scale == 1) {
+                return -EINVAL; // finer than 1 mHz
+            }
+            scale /= 10;
+            frac += (*p - '0') * scale;
+        }
+    }
+    if (isdigit(*p)) {
+        return -EINVAL; // too many integer digits
+    }
+    *mhz = hz * 1000 + frac;
+    return 0;
+}
+
+static ssize_t mytraffic_write(struct file *filp, const char *buf, size_t count, loff_t *f_pos) {
+    traffic_light_t *light = file_light(filp);
+    char kbuf[256];
+    u32 new_rate;
+
+    if (count > sizeof(kbuf) - 1) {
+        return -1;
+    }
+
+    if (copy_from_user(kbuf, buf, count)) {
+        return -EFAULT;
+    }
+
+    kbuf[count] = '\0'; // null terminate string
+
+    if (parse_rate_mhz(kbuf, &new_rate) == 0) { // check for valid input
+        if (new_rate < MYTRAFFIC_MIN_RATE_MHZ || new_rate > MYTRAFFIC_MAX_RATE_MHZ) {
+            return -1; // invalid cycle rate
+        } else {
+            struct mytraffic_record rec = { .type = MYTRAFFIC_REC_RATE, .value = new_rate };
+
+            mutex_lock(&light->lock);
+            // set new cycle rate, the current phase continues at the new rate right away
+            rec.time_ns = ktime_get_ns();
+            if (traffic_fsm_set_rate(&light->fsm, new_rate, rec.time_ns)) {
+                arm_timer(light);
+            }
+            record_input(light, &rec, NULL, 0);
+            publish_snapshot(light);
+            mutex_unlock(&light->lock);
+            return count;
+        }
+    } 
+
+    // otherwise invalid input
+    return -1;
+}
+
+// debugfs log: hand out whole entries, oldest first
+static ssize_t log_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos) {
+    traffic_light_t *light = filp->private_data;
+    unsigned int copied;
+    int result;
+
+    if (count < sizeof(struct mytraffic_log_entry)) {
+        return -EINVAL;
+    }
+
+    mutex_lock(&light->log_read_lock);
+    result = kfifo_to_user(&light->log, buf, count, &copied);
+    mutex_unlock(&light->log_read_lock);
+
+    return result ? result : copied;
+}
+
+static const struct file_operations log_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = log_read
+};
+
+// debugfs record: the one opener gets the current state, then every input until it closes the file
+static int record_open(struct inode *inode, struct file *filp) {
+    traffic_light_t *light = inode->i_private;
+    struct mytraffic_record rec = { .type = MYTRAFFIC_REC_STATE, .value = MYTRAFFIC_RECORD_VERSION };
+    struct mytraffic_fsm_state state;
+    int result;
+
+    mutex_lock(&light->lock);
+    if (light->record_open) {
+        mutex_unlock(&light->lock);
+        return -EBUSY;
+    }
+    light->record_open = true;
+    mutex_unlock(&light->lock);
+
+    result = kfifo_alloc(&light->record, record_kb * 1024, GFP_KERNEL);
+    if (result < 0) {
+        mutex_lock(&light->lock);
+        light->record_open = false;
+        mutex_unlock(&light->lock);
+        return result;
+    }
+
+    mutex_lock(&light->lock);
+    light->record_lost = false;
+    light->recording = true;
+    traffic_fsm_save(&light->fsm, &state);
+    rec.time_ns = ktime_get_ns();
+    record_input(light, &rec, &state, sizeof(state));
+    mutex_unlock(&light->lock);
+
+    filp->private_data = light;
+    return nonseekable_open(inode, filp);
+}
+
+static ssize_t record_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos) {
+    traffic_light_t *light = filp->private_data;
+    unsigned int copied;
+    int result;
+
+    // lost or not, what was recorded before is handed out first
+    if (kfifo_is_empty(&light->record)) {
+        if (READ_ONCE(light->record_lost)) {
+            return -EOVERFLOW;
+        }
+        if (filp->f_flags & O_NONBLOCK) {
+            return -EAGAIN;
+        }
+        if (wait_event_interruptible(light->record_wait,
+                !kfifo_is_empty(&light->record) || READ_ONCE(light->record_lost))) {
+            return -ERESTARTSYS;
+        }
+    }
+
+    mutex_lock(&light->record_read_lock);
+    result = kfifo_to_user(&light->record, buf, count, &copied);
+    mutex_unlock(&light->record_read_lock);
+
+    return result ? result : copied;
+}
+
+static int record_release(struct inode *inode, struct file *filp) {
+    traffic_light_t *light = filp->private_data;
+
+    mutex_lock(&light->lock);
+    light->recording = false;
+    kfifo_free(&light->record);
+    light->record_open = false;
+    mutex_unlock(&light->lock);
+    return 0;
+}
+
+static const struct file_operations record_fops = {
+	.owner = THIS_MODULE,
+	.open = record_open,
+	.read = record_read,
+	.release = record_release
+};
+
+static void hist_show(struct seq_file *m, const char *name, const histogram_t *hist) {
+    unsigned int mode, b;
+
+    for (mode = 0; mode < NUM_MODES; mode++, hist++) {
+        if (!hist->count) {
+            continue;
+        }
+        seq_printf(m, "%s %s: count %llu min %lld max %lld p50 %lld p90 %lld p99 %lld ns\n",
+            name, mode_names[mode], hist->count, hist->min, hist->max,
+            hist_percentile(hist, 50), hist_percentile(hist, 90), hist_percentile(hist, 99));
+        for (b = 0; b < HIST_BUCKETS; b++) {
+            if (hist->buckets[b]) {
+                seq_printf(m, "  %s%lld ns: %u\n", b == HIST_BUCKETS - 1 ? ">= " : "< ",
+                    b == HIST_BUCKETS - 1 ? 1LL << (b - 1) : b ? 1LL << b : 1, hist->buckets[b]);
+            }
+        }
+    }
+}
+
+// debugfs histograms: copy under lock, format without holding it
+static int hist_seq_show(struct seq_file *m, void *unused) {
+    traffic_light_t *light = m->private;
+    light_histograms_t *hist;
+
+    hist = kmalloc(sizeof(*hist), GFP_KERNEL);
+    if (!hist) {
+        return -ENOMEM;
+    }
+    mutex_lock(&light->lock);
+    memcpy(hist, light->hist, sizeof(*hist));
+    mutex_unlock(&light->lock);
+
+    hist_show(m, "timer-lateness", hist->lateness);
+    hist_show(m, "handler", hist->handler);
+    kfree(hist);
+    return 0;
+}
+
+static int hist_open(struct inode *inode, struct file *filp) {
+    return single_open(filp, hist_seq_show, inode->i_private);
+}
+
+// any write resets the histograms
+static ssize_t hist_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos) {
+    traffic_light_t *light = ((struct seq_file *)filp->private_data)->private;
+
+    mutex_lock(&light->lock);
+    memset(light->hist, 0, sizeof(*light->hist));
+    mutex_unlock(&light->lock);
+    return count;
+}
+
+static const struct file_operations hist_fops = {
+	.owner = THIS_MODULE,
+	.open = hist_open,
+	.read = seq_read,
+	.write = hist_write,
+	.llseek = seq_lseek,
+	.release = single_release
+};
+
+// debugfs debounce statistics
+static int debounce_seq_show(struct seq_file *m, void *unused) {
+    traffic_light_t *light = m->private;
+    debounce_t stats[2];
+    unsigned long flags;
+    unsigned int b;
+
+    raw_spin_lock_irqsave(&light->event_lock, flags);
+    memcpy(stats, light->debounce, sizeof(stats));
+    raw_spin_unlock_irqrestore(&light->event_lock, flags);
+
+    for (b = 0; b < 2; b++) {
+        seq_printf(m, "btn%u: %s %lld ms, %llu edges, %llu bounces, %llu accepted\n", b,
+            stats[b].hardware ? "hardware" : "software", ktime_to_ms(stats[b].window),
+            stats[b].edges, stats[b].bounces, stats[b].accepted);
+    }
+    return 0;
+}
+
+static int debounce_open(struct inode *inode, struct file *filp) {
+    return single_open(filp, debounce_seq_show, inode->i_private);
+}
+
+static const struct file_operations debounce_fops = {
+	.owner = THIS_MODULE,
+	.open = debounce_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release
+};
+
+#ifdef MYTRAFFIC_STORM
+#define STORM_MAX_MS 60000
+#define STORM_MAX_RATE 10000000 // events/s per CPU
+
+// storm settings (debugfs mytraffic/storm/), read when a storm starts
+static u32 storm_light;
+static u32 storm_event = EVENT_DETECTOR;
+static u32 storm_rate = 10000;
+static u32 storm_cpus = 1;
+static u32 storm_ms = 1000;
+static DEFINE_MUTEX(storm_lock); // one storm at a time, protects storm_report
+static char storm_report[256];
+
+// one storm thread, bound to its CPU
+typedef struct {
+    traffic_light_t *light;
+    event_t event;
+    u32 rate;
+    u64 sent;
+    struct task_struct *task;
+} storm_thread_t;
+
+static int storm_thread(void *data) {
+    storm_thread_t *st = data;
+    ktime_t start = ktime_get();
+    u64 due;
+
+    while (!kthread_should_stop()) {
+        // catch up to rate * elapsed: the rate holds whatever the sleep granularity, in bursts
+        due = div_u64((u64)ktime_to_ns(ktime_sub(ktime_get(), start)) * st->rate, NSEC_PER_SEC);
+        while (st->sent < due) {
+            queue_event(st->light, st->event, ktime_get());
+            st->sent++;
+        }
+        usleep_range(50, 100);
+    }
+    return 0;
+}
+
+// run one storm with the current settings and fill storm_report
+static int storm_run(void) {
+    traffic_light_t *light = &lights[storm_light];
+    storm_thread_t *threads;
+    u64 dropped, sent = 0;
+    unsigned long flags;
+    unsigned int cpu, n = 0, i;
+    int result = 0;
+
+    threads = kcalloc(storm_cpus, sizeof(*threads), GFP_KERNEL);
+    if (!threads) {
+        return -ENOMEM;
+    }
+
+    mutex_lock(&light->lock);
+    light->storm_handled = 0;
+    light->storm_max_latency_ns = 0;
+    mutex_unlock(&light->lock);
+    raw_spin_lock_irqsave(&light->event_lock, flags);
+    dropped = light->events_dropped;
+    raw_spin_unlock_irqrestore(&light->event_lock, flags);
+
+    for_each_online_cpu(cpu) {
+        if (n == storm_cpus) {
+            break;
+        }
+        threads[n].light = light;
+        threads[n].event = storm_event;
+        threads[n].rate = storm_rate;
+        threads[n].task = kthread_create(storm_thread, &threads[n], "mytraffic_storm/%u", cpu);
+        if (IS_ERR(threads[n].task)) {
+            result = PTR_ERR(threads[n].task);
+            goto out;
+        }
+        kthread_bind(threads[n].task, cpu);
+        n++;
+    }
+    for (i = 0; i < n; i++) {
+        wake_up_process(threads[i].task);
+    }
+    msleep(storm_ms);
+
+out:
+    for (i = 0; i < n; i++) {
+        kthread_stop(threads[i].task);
+        sent += threads[i].sent;
+    }
+    kfree(threads);
+    if (result < 0) {
+        return result;
+    }
+
+    kthread_flush_work(&light->event_work); // let the worker drain the queue
+    raw_spin_lock_irqsave(&light->event_lock, flags);
+    dropped = light->events_dropped - dropped;
+    raw_spin_unlock_irqrestore(&light->event_lock, flags);
+    mutex_lock(&light->lock);
+    snprintf(storm_report, sizeof(storm_report),
+        "light %u event %u: %u cpus x %u events/s for %u ms\n"
+        "sent %llu handled %llu dropped %llu\n"
+        "max latency %lld ns\n",
+        storm_light, storm_event, n, storm_rate, storm_ms,
+        sent, light->storm_handled, dropped, light->storm_max_latency_ns);
+    mutex_unlock(&light->lock);
+    return 0;
+}
+
+static ssize_t storm_run_write(struct file *filp, const char __user *buf, size_t count, loff_t *f_pos) {
+    int result;
+
+    // a synthetic timer expiry would be accounted as a real timer fire
+    if (storm_light >= num_lights || storm_event >= NUM_EVENTS || storm_event == EVENT_TIMER_EXPIRE || storm_rate < 1 || storm_rate > STORM_MAX_RATE ||
+        storm_cpus < 1 || storm_cpus > num_online_cpus() || storm_ms < 1 || storm_ms > STORM_MAX_MS) {
+        return -EINVAL;
+    }
+    if (mutex_lock_interruptible(&storm_lock)) {
+        return -ERESTARTSYS;
+    }
+    result = storm_run();
+    mutex_unlock(&storm_lock);
+    return result < 0 ? result : count;
+}
+
+static ssize_t storm_run_read(struct file *filp, char __user *buf, size_t count, loff_t *f_pos) {
+    ssize_t result;
+
+    // held by a running storm for up to STORM_MAX_MS
+    if (mutex_lock_interruptible(&storm_lock)) {
+        return -ERESTARTSYS;
+    }
+    result = simple_read_from_buffer(buf, count, f_pos, storm_report, strlen(storm_report));
+    mutex_unlock(&storm_lock);
+    return result;
+}
+
+static const struct file_operations storm_run_fops = {
+	.owner = THIS_MODULE,
+	.open = simple_open,
+	.read = storm_run_read,
+	.write = storm_run_write
+};
+
+static void storm_debugfs_init(void) {
+    struct dentry *dir = debugfs_create_dir("storm", mytraffic_debugfs);
+
+    debugfs_create_u32("light", 0600, dir, &storm_light);
+    debugfs_create_u32("event", 0600, dir, &storm_event);
+    debugfs_create_u32("rate", 0600, dir, &storm_rate);
+    debugfs_create_u32("cpus", 0600, dir, &storm_cpus);
+    debugfs_create_u32("ms", 0600, dir, &storm_ms);
+    debugfs_create_file("run", 0600, dir, NULL, &storm_run_fops);
+}
+#endif
+
+// debugfs counters, summed over all CPUs
+static int counters_seq_show(struct seq_file *m, void *unused) {
+    traffic_light_t *light = m->private;
+    light_counters_t *sum;
+    const light_counters_t *c;
+    unsigned int cpu, e, mode;
+
+    sum = kzalloc(sizeof(*sum), GFP_KERNEL);
+    if (!sum) {
+        return -ENOMEM;
+    }
+    for_each_possible_cpu(cpu) {
+        c = per_cpu_ptr(light->counters, cpu);
+        for (e = 0; e < NUM_EVENTS; e++) {
+            sum->events[e] += c->events[e];
+            for (mode = 0; mode < NUM_MODES; mode++) {
+                sum->transitions[e][mode] += c->transitions[e][mode];
+            }
+        }
+        sum->debounce_rejects += c->debounce_rejects;
+        sum->timer_fires += c->timer_fires;
+        sum->gpio_writes += c->gpio_writes;
+    }
+
+    for (e = 0; e < NUM_EVENTS; e++) {
+        seq_printf(m, "event %s: %llu\n", event_names[e], sum->events[e]);
+    }
+    for (e = 0; e < NUM_EVENTS; e++) {
+        for (mode = 0; mode < NUM_MODES; mode++) {
+            seq_printf(m, "transition %s %s -> %s: %llu\n", event_names[e], mode_names[mode],
+                mode_names[state_transition_table[e][mode]], sum->transitions[e][mode]);
+        }
+    }
+    seq_printf(m, "debounce rejects: %llu\n", sum->debounce_rejects);
+    seq_printf(m, "timer fires: %llu\n", sum->timer_fires);
+    seq_printf(m, "gpio writes: %llu\n", sum->gpio_writes);
+    kfree(sum);
+    return 0;
+}
+
+static int counters_open(struct inode *inode, struct file *filp) {
+    return single_open(filp, counters_seq_show, inode->i_private);
+}
+
+static const struct file_operations counters_fops = {
+	.owner = THIS_MODULE,
+	.open = counters_open,
+	.read = seq_read,
+	.llseek = seq_lseek,
+	.release = single_release
+};
+
+static void light_debugfs_init(traffic_light_t *light) {
+    char name[16];
+
+    snprintf(name, sizeof(name), "%u", light->index);
+    light->debugfs_dir = debugfs_create_dir(name, mytraffic_debugfs);
+    debugfs_create_file("log", 0400, light->debugfs_dir, light, &log_fops);
+    debugfs_create_u64("log_overflows", 0444, light->debugfs_dir, &light->log_overflows);
+    debugfs_create_file("histograms", 0600, light->debugfs_dir, light, &hist_fops);
+    debugfs_create_u64("detector_calls", 0444, light->debugfs_dir, &light->detector_calls);
+    debugfs_create_file("debounce", 0444, light->debugfs_dir, light, &debounce_fops);
+    debugfs_create_file("record", 0400, light->debugfs_dir, light, &record_fops);
+    debugfs_create_file("counters", 0444, light->debugfs_dir, light, &counters_fops);
+}
+
+// /proc/mytraffic: a header line (position 0), then light N at position N + 1
+static void *proc_seq_start(struct seq_file *m, loff_t *pos) {
+    if (*pos == 0) {
+        return SEQ_START_TOKEN;
+    }
+    return *pos <= num_lights ? &lights[*pos - 1] : NULL;
+}
+
+static void *proc_seq_next(struct seq_file *m, void *v, loff_t *pos) {
+    ++*pos;
+    return proc_seq_start(m, pos);
+}
+
+static void proc_seq_stop(struct seq_file *m, void *v) {
+}
+
+static int proc_seq_show(struct seq_file *m, void *v) {
+    traffic_light_t *light = v;
+    light_snapshot_t snap;
+    char rate[16];
+    s64 remaining;
+
+    if (v == SEQ_START_TOKEN) {
+        seq_puts(m, "light mode lamps rate_hz remaining_ms changes timer_fires events_dropped detector_calls log_overflows\n");
+        return 0;
+    }
+
+    read_snapshot(light, &snap);
+    format_rate(rate, snap.cycle_rate_mhz);
+    seq_printf(m, "%u %s %c%c%c %s ", light->index, mode_names[snap.mode],
+        snap.status & LIGHT_RED ? 'R' : '-', snap.status & LIGHT_YELLOW ? 'Y' : '-',
+        snap.status & LIGHT_GREEN ? 'G' : '-', rate);
+    if (ktime_to_ns(snap.deadline) == MYTRAFFIC_NO_DEADLINE) {
+        seq_puts(m, "- ");
+    } else {
+        remaining = max_t(s64, ktime_to_ns(ktime_sub(snap.deadline, ktime_get())), 0);
+        seq_printf(m, "%lld ", div_s64(remaining, NSEC_PER_MSEC));
+    }
+    seq_printf(m, "%u %llu %llu %llu %llu\n", snap.generation, snap.timer_fires,
+        light->events_dropped, light->detector_calls, light->log_overflows);
+    return 0;
+}
+
+static const struct seq_operations proc_seq_ops = {
+	.start = proc_seq_start,
+	.next = proc_seq_next,
+	.stop = proc_seq_stop,
+	.show = proc_seq_show
+};
+
+static int mytraffic_mmap(struct file *filp, struct vm_area_struct *vma) {
+    traffic_light_t *light = file_light(filp);
+
+    // exactly the one status page, read-only
+    if (vma->vm_pgoff != 0 || vma->vm_end - vma->vm_start != PAGE_SIZE) {
+        return -EINVAL;
+    }
+    if (vma->vm_flags & VM_WRITE) {
+        return -EPERM;
+    }
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(6, 3, 0)
+    vm_flags_clear(vma, VM_MAYWRITE);
+#else
+    vma->vm_flags &= ~VM_MAYWRITE; // no mprotect() to writable later
+#endif
+
+    return remap_pfn_range(vma, vma->vm_start, virt_to_phys(light->shared) >> PAGE_SHIFT,
+        PAGE_SIZE, vma->vm_page_prot);
+}
+
+static struct file_operations mytraffic_fops = {
+	.owner = THIS_MODULE,
+	.open = mytraffic_open,
+	.release = mytraffic_release,
+	.read = mytraffic_read,
+	.write = mytraffic_write,
+	.poll = mytraffic_poll,
+	.unlocked_ioctl = mytraffic_ioctl,
+	.mmap = mytraffic_mmap
+};
+
+// pick the GPIO set of light i: explicit pins first, then consecutive blocks from gpio_base
+static int light_config(traffic_light_t *light, unsigned int i) {
+    unsigned int num_pin_sets = num_pins / NUM_PINS;
+    int p;
+
+    light->index = i;
+    for (p = 0; p < NUM_PINS; p++) {
+        if (i < num_pin_sets) {
+            light->gpios[p] = pins[i * NUM_PINS + p];
+        } else if (gpio_base >= 0) {
+            light->gpios[p] = gpio_base + (i - num_pin_sets) * NUM_PINS + p;
+        } else {
+            printk(KERN_ERR "No GPIOs configured for traffic light %u\n", i);
+            return -EINVAL;
+        }
+    }
+
+    // detectors are optional, only the lights listed in detectors have them
+    if ((i + 1) * detectors_per_light <= num_detector_gpios) {
+        light->num_detectors = detectors_per_light;
+        for (p = 0; p < detectors_per_light; p++) {
+            light->detector_gpios[p] = detectors[i * detectors_per_light + p];
+        }
+    }
+    return 0;
+}
+
+// run the event worker as a SCHED_FIFO thread so button and timer events preempt normal tasks
+static void set_worker_priority(struct kthread_worker *worker) {
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(5, 9, 0)
+    sched_set_fifo(worker->task);
+#else
+    struct sched_param param = { .sched_priority = MAX_USER_RT_PRIO / 2 };
+
+    sched_setscheduler(worker->task, SCHED_FIFO, &param);
+#endif
+}
+
+static int light_init(traffic_light_t *light, unsigned int i) {
+    int result;
+
+    result = light_config(light, i);
+    if (result < 0) {
+        return result;
+    }
+
+    // initialize traffic light struct
+    traffic_fsm_init(&light->fsm, ktime_to_ns(ktime_get())); // normal mode, 1 Hz, red for 2 cycles
+    if (light->num_detectors) {
+        traffic_fsm_actuate_entry(&light->fsm, ACTUATED_MIN_GREEN, ACTUATED_GAP, ACTUATED_MAX_GREEN);
+    }
+    mytraffic_hrtimer_setup(&light->timer, mytraffic_timer_callback, MYTRAFFIC_HRTIMER_MODE); // initialize timer with callback
+    INIT_KFIFO(light->events); // initialize event queue and its worker
+    raw_spin_lock_init(&light->event_lock);
+    kthread_init_work(&light->event_work, mytraffic_event_work);
+    mutex_init(&light->lock);
+    seqcount_init(&light->snapshot_seq);
+    init_waitqueue_head(&light->wait);
+
+    // page shared with user space through mmap()
+    light->shared = (struct mytraffic_shared *)get_zeroed_page(GFP_KERNEL);
+    if (!light->shared) {
+        printk(KERN_ERR "Failed to allocate status page of traffic light %u\n", i);
+        return -ENOMEM;
+    }
+    light->shared->version = MYTRAFFIC_SHARED_VERSION;
+
+    // transition log
+    mutex_init(&light->log_read_lock);
+    mutex_init(&light->record_read_lock);
+    init_waitqueue_head(&light->record_wait);
+    result = kfifo_alloc(&light->log, log_entries, GFP_KERNEL);
+    if (result < 0) {
+        printk(KERN_ERR "Failed to allocate transition log of traffic light %u\n", i);
+        goto err_page;
+    }
+
+    // latency histograms
+    light->hist = kzalloc(sizeof(light_histograms_t), GFP_KERNEL);
+    if (!light->hist) {
+        printk(KERN_ERR "Failed to allocate histograms of traffic light %u\n", i);
+        result = -ENOMEM;
+        goto err_log;
+    }
+
+    // counters, before the IRQs start counting
+    light->counters = alloc_percpu(light_counters_t);
+    if (!light->counters) {
+        printk(KERN_ERR "Failed to allocate counters of traffic light %u\n", i);
+        result = -ENOMEM;
+        goto err_hist;
+    }
+    
+    // set up GPIOs
+    if (gpio_init(light) < 0) {
+        printk(KERN_ERR "Failed to initialize GPIOs of traffic light %u\n", i);
+        result = -EIO;
+        goto err_counters;
+    }
+
+    light_debugfs_init(light);
+
+    mutex_lock(&light->lock); // buttons may already be queueing events
+    hrtimer_start(&light->timer, ns_to_ktime(light->fsm.deadline), MYTRAFFIC_HRTIMER_MODE); // start the timer
+    publish_snapshot(light);
+    mutex_unlock(&light->lock);
+    return 0;
+
+err_counters:
+    kthread_cancel_work_sync(&light->event_work); // buttons may have queued events before gpio_init failed
+    free_percpu(light->counters);
+err_hist:
+    kfree(light->hist);
+err_log:
+    kfifo_free(&light->log);
+err_page:
+    free_page((unsigned long)light->shared);
+    return result;
+}
+
+static void light_exit(traffic_light_t *light) {
+    // free IRQs first so no new button events are queued
+    gpio_irqs_exit(light);
+
+    // stop the worker from re-arming the timer, then stop the timer and drain queued events
+    mutex_lock(&light->lock);
+    light->stopping = true;
+    mutex_unlock(&light->lock);
+    hrtimer_cancel(&light->timer); // ensure timer is fully stopped
+    kthread_cancel_work_sync(&light->event_work);
+
+    // nothing drives the lamps any more
+    gpio_exit(light);
+
+    debugfs_remove_recursive(light->debugfs_dir);
+    free_percpu(light->counters);
+    kfree(light->hist);
+    kfifo_free(&light->log);
+    free_page((unsigned long)light->shared);
+}
+
+static int mytraffic_init(void) {
+    int result;
+    unsigned int i;
+
+    if (num_lights < 1 || num_lights > MYTRAFFIC_MAX_LIGHTS) {
+        printk(KERN_ERR "num_lights must be between 1 and %d\n", MYTRAFFIC_MAX_LIGHTS);
+        return -EINVAL;
+    }
+    if (num_pins % NUM_PINS) {
+        printk(KERN_ERR "pins must list %d GPIOs per traffic light\n", NUM_PINS);
+        return -EINVAL;
+    }
+    if (detectors_per_light > MYTRAFFIC_MAX_DETECTORS) {
+        printk(KERN_ERR "detectors_per_light must be at most %d\n", MYTRAFFIC_MAX_DETECTORS);
+        return -EINVAL;
+    }
+
+    // one real-time worker thread runs the state machines of all lights
+    mytraffic_worker = mytraffic_create_worker("mytraffic");
+    if (IS_ERR(mytraffic_worker)) {
+        printk(KERN_ERR "Failed to create event worker\n");
+        return PTR_ERR(mytraffic_worker);
+    }
+    set_worker_priority(mytraffic_worker);
+
+    mytraffic_debugfs = debugfs_create_dir("mytraffic", NULL);
+#ifdef MYTRAFFIC_STORM
+    storm_debugfs_init();
+#endif
+
+    lights = kvcalloc(num_lights, sizeof(traffic_light_t), GFP_KERNEL); // allocate memory for traffic light structs
+    if (!lights) {
+        printk(KERN_ERR "Failed to allocate memory for traffic light structs\n");
+        debugfs_remove_recursive(mytraffic_debugfs);
+        kthread_destroy_worker(mytraffic_worker);
+        return -ENOMEM;
+    }
+
+    for (i = 0; i < num_lights; i++) {
+        result = light_init(&lights[i], i);
+        if (result < 0) {
+            goto err_lights;
+        }
+    }
+
+    mytraffic_proc = proc_create_seq("mytraffic", 0444, NULL, &proc_seq_ops);
+    if (!mytraffic_proc) {
+        printk(KERN_ERR "Failed to create /proc/mytraffic\n");
+        result = -ENOMEM;
+        goto err_lights;
+    }
+
+    // register char device, one minor per traffic light
+    result = register_chrdev_region(MKDEV(MYTRAFFIC_MAJOR, 0), num_lights, "mytraffic");
+    if (result < 0) {
+        printk(KERN_ERR "Failed to register char device\n");
+        goto err_proc;
+    }
+    cdev_init(&mytraffic_cdev, &mytraffic_fops);
+    mytraffic_cdev.owner = THIS_MODULE;
+    result = cdev_add(&mytraffic_cdev, MKDEV(MYTRAFFIC_MAJOR, 0), num_lights);
+    if (result < 0) {
+        printk(KERN_ERR "Failed to add char device\n");
+        goto err_region;
+    }
+
+    // create /dev/mytrafficN nodes
+    mytraffic_class = mytraffic_class_create("mytraffic");
+    if (IS_ERR(mytraffic_class)) {
+        printk(KERN_ERR "Failed to create device class\n");
+        result = PTR_ERR(mytraffic_class);
+        goto err_cdev;
+    }
+    for (i = 0; i < num_lights; i++) {
+        device_create(mytraffic_class, NULL, MKDEV(MYTRAFFIC_MAJOR, i), NULL, "mytraffic%u", i);
+    }
+
+    return 0;
+
+err_cdev:
+    cdev_del(&mytraffic_cdev);
+err_region:
+    unregister_chrdev_region(MKDEV(MYTRAFFIC_MAJOR, 0), num_lights);
+err_proc:
+    proc_remove(mytraffic_proc);
+    i = num_lights;
+err_lights:
+    while (i--) {
+        light_exit(&lights[i]);
+    }
+    debugfs_remove_recursive(mytraffic_debugfs);
+    kthread_destroy_worker(mytraffic_worker); // nothing queued may outlive the lights
+    kvfree(lights);
+    return result;
+}
+
+static void mytraffic_exit(void) {
+    unsigned int i;
+
+    // remove device nodes and unregister char device
+    for (i = 0; i < num_lights; i++) {
+        device_destroy(mytraffic_class, MKDEV(MYTRAFFIC_MAJOR, i));
+    }
+    class_destroy(mytraffic_class);
+    cdev_del(&mytraffic_cdev);
+    unregister_chrdev_region(MKDEV(MYTRAFFIC_MAJOR, 0), num_lights);
+    proc_remove(mytraffic_proc); // waits for readers still walking the lights
+
+    // stop traffic lights and free traffic light structs
+    for (i = 0; i < num_lights; i++) {
+        light_exit(&lights[i]);
+    }
+    debugfs_remove_recursive(mytraffic_debugfs);
+    kthread_destroy_worker(mytraffic_worker); // nothing queued may outlive the lights
+    kvfree(lights);
+}
+
+static int gpio_init(traffic_light_t *light) {
+    int p, d, b;
+
+    if (!light) {
+        printk(KERN_ERR "Invalid traffic light pointer\n");
+        return -1;
+    }
+
+    for (p = 0; p < NUM_PINS; p++) {
+        // set up GPIO
+        if (gpio_request(light->gpios[p], pin_names[p])) {
+            printk(KERN_ERR "Failed to allocate GPIO %d\n", light->gpios[p]);
+            goto err_gpios;
+        }
+        // lights are outputs (initially off), buttons are inputs
+        if (p < NUM_LAMPS ? gpio_direction_output(light->gpios[p], 0) : gpio_direction_input(light->gpios[p])) {
+            printk(KERN_ERR "Failed to set GPIO %d direction\n", light->gpios[p]);
+            p++; // this GPIO was allocated, free it too
+            goto err_gpios;
+        }
+        if (p < NUM_LAMPS) {
+            light->lamps[p] = gpio_to_desc(light->gpios[p]);
+        }
+    }
+    light->output = 0; // all lamps start off
+    light->buttons = (gpio_get_value_cansleep(light->gpios[PIN_BTN_0]) ? BTN_0_DOWN : 0) |
+        (gpio_get_value_cansleep(light->gpios[PIN_BTN_1]) ? BTN_1_DOWN : 0); // IRQs track changes from here
+    for (b = 0; b < 2; b++) {
+        debounce_t *db = &light->debounce[b];
+
+        db->light = light;
+        db->btn = b;
+        db->window = ms_to_ktime(debounce_ms[b]);
+        // prefer the controller's debounce, it saves the IRQs of every bounce
+        db->hardware = debounce_ms[b] &&
+            !gpiod_set_debounce(gpio_to_desc(light->gpios[PIN_BTN_0 + b]), debounce_ms[b] * USEC_PER_MSEC);
+        mytraffic_hrtimer_setup(&db->settle, debounce_timer_callback, MYTRAFFIC_DEBOUNCE_MODE);
+        kthread_init_work(&db->sample, debounce_sample_work);
+    }
+
+    // set up BTN_0 IRQ
+    light->btn_0_irq = gpio_to_irq(light->gpios[PIN_BTN_0]);
+    if (request_irq(light->btn_0_irq, btn_0_irq_handler, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, "btn_0_irq", light) != 0) {
+        printk(KERN_ERR "Failed to request IRQ %d\n", light->btn_0_irq);
+        goto err_gpios;
+    }
+
+    // set up BTN_1 IRQ
+    light->btn_1_irq = gpio_to_irq(light->gpios[PIN_BTN_1]);
+    if (request_irq(light->btn_1_irq, btn_1_irq_handler, IRQF_TRIGGER_RISING | IRQF_TRIGGER_FALLING, "btn_1_irq", light) != 0) {
+        printk(KERN_ERR "Failed to request IRQ %d\n", light->btn_1_irq);
+        goto err_btn_1;
+    }
+
+    // set up vehicle detectors
+    for (d = 0; d < light->num_detectors; d++) {
+        if (gpio_request(light->detector_gpios[d], "DETECTOR")) {
+            printk(KERN_ERR "Failed to allocate GPIO %d\n", light->detector_gpios[d]);
+            goto err_detectors;
+        }
+        light->detector_irqs[d] = gpio_to_irq(light->detector_gpios[d]);
+        if (gpio_direction_input(light->detector_gpios[d]) ||
+            request_irq(light->detector_irqs[d], detector_irq_handler, IRQF_TRIGGER_RISING, "detector_irq", light) != 0) {
+            printk(KERN_ERR "Failed to set up detector GPIO %d\n", light->detector_gpios[d]);
+            gpio_free(light->detector_gpios[d]);
+            goto err_detectors;
+        }
+    }
+
+    return 0;
+
+err_detectors:
+    while (d--) {
+        free_irq(light->detector_irqs[d], light);
+        gpio_free(light->detector_gpios[d]);
+    }
+    free_irq(light->btn_1_irq, light);
+err_btn_1:
+    free_irq(light->btn_0_irq, light);
+    // an edge during the load may have armed a settle timer or queued a read, of either button
+    for (b = 0; b < 2; b++) {
+        hrtimer_cancel(&light->debounce[b].settle);
+        kthread_cancel_work_sync(&light->debounce[b].sample);
+    }
+err_gpios:
+    // free GPIOs in case of error
+    while (p--) {
+        gpio_free(light->gpios[p]);
+    }
+    return -1;
+}
+
+// stop the inputs: no new events are queued afterwards, the lamps are still driven
+static void gpio_irqs_exit(traffic_light_t *light) {
+    int d, b;
+
+    for (d = light->num_detectors - 1; d >= 0; d--) {
+        free_irq(light->detector_irqs[d], light);
+    }
+    free_irq(light->btn_1_irq, light);
+    free_irq(light->btn_0_irq, light);
+    for (b = 0; b < 2; b++) {
+        hrtimer_cancel(&light->debounce[b].settle); // no more edges can restart it
+        kthread_cancel_work_sync(&light->debounce[b].sample); // nor queue a read
+    }
+}
+
+// free the lines, once nothing can drive the lamps any more
+static void gpio_exit(traffic_light_t *light) {
+    int p, d;
+
+    for (d = light->num_detectors - 1; d >= 0; d--) {
+        gpio_free(light->detector_gpios[d]);
+    }
+    for (p = NUM_PINS - 1; p >= 0; p--) {
+        gpio_free(light->gpios[p]);
+    }
+}
+
+void set_light_status(traffic_light_t *light) {
+    if (light->fsm.status == light->output) {
+        return; // lamps already show this status
+    }
+
+    // lamps on the same GPIO bank change together in a single register write
+#if LINUX_VERSION_CODE >= KERNEL_VERSION(4, 20, 0)
+    {
+        unsigned long values = light->fsm.status;
+
+        gpiod_set_array_value_cansleep(NUM_LAMPS, light->lamps, NULL, &values);
+    }
+#else
+    {
+        int values[NUM_LAMPS] = {
+            !!(light->fsm.status & LIGHT_RED),
+            !!(light->fsm.status & LIGHT_YELLOW),
+            !!(light->fsm.status & LIGHT_GREEN)
+        };
+
+        gpiod_set_array_value_cansleep(NUM_LAMPS, light->lamps, values);
+    }
+#endif
+    light->output = light->fsm.status;
+    this_cpu_inc(light->counters->gpio_writes);
+    trace_mytraffic_lamps(light->index, light->fsm.status);
+}
+
+module_init(mytraffic_init);
+module_exit(mytraffic_exit);
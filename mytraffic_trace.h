@@ -0,0 +1,132 @@
+/*
+	Tracepoints of the traffic light module
+
+	Enable with e.g. echo 1 > /sys/kernel/debug/tracing/events/mytraffic/enable, or perf record -e 'mytraffic:*'
+	Disabled tracepoints cost a single patched-out branch.
+
+*/
+
+#undef TRACE_SYSTEM
+#define TRACE_SYSTEM mytraffic
+
+#if !defined(_MYTRAFFIC_TRACE_H) || defined(TRACE_HEADER_MULTI_READ)
+#define _MYTRAFFIC_TRACE_H
+
+#include <linux/tracepoint.h>
+
+#include "mytraffic.h"
+
+#define show_mytraffic_event(event) __print_symbolic(event, \
+    { MYTRAFFIC_EVENT_BTN_0_PRESS, "btn-0" }, \
+    { MYTRAFFIC_EVENT_BTN_1_PRESS, "btn-1" }, \
+    { MYTRAFFIC_EVENT_BOTH_BTNS_PRESS, "both-btns" }, \
+    { MYTRAFFIC_EVENT_TIMER_EXPIRE, "timer" }, \
+    { MYTRAFFIC_EVENT_DETECTOR, "detector" }, \
+    { MYTRAFFIC_EVENT_BTN_RELEASE, "btn-release" })
+
+#define show_mytraffic_mode(mode) __print_symbolic(mode, \
+    { MYTRAFFIC_MODE_NORMAL, "normal" }, \
+    { MYTRAFFIC_MODE_FLASHING_RED, "flashing-red" }, \
+    { MYTRAFFIC_MODE_FLASHING_YELLOW, "flashing-yellow" }, \
+    { MYTRAFFIC_MODE_PEDESTRIAN, "pedestrian-mode" }, \
+    { MYTRAFFIC_MODE_LIGHTBULB_CHECK, "lightbulb-check" })
+
+#define show_mytraffic_lamps(lamps) __print_flags(lamps, "|", \
+    { MYTRAFFIC_LAMP_RED, "red" }, \
+    { MYTRAFFIC_LAMP_YELLOW, "yellow" }, \
+    { MYTRAFFIC_LAMP_GREEN, "green" })
+
+// an IRQ or the phase timer queued an event for the state machine
+TRACE_EVENT(mytraffic_event,
+    TP_PROTO(unsigned int light, unsigned int event, bool queued),
+    TP_ARGS(light, event, queued),
+    TP_STRUCT__entry(
+        __field(unsigned int, light)
+        __field(unsigned int, event)
+        __field(bool, queued)
+    ),
+    TP_fast_assign(
+        __entry->light = light;
+        __entry->event = event;
+        __entry->queued = queued;
+    ),
+    TP_printk("light=%u event=%s%s", __entry->light, show_mytraffic_event(__entry->event),
+        __entry->queued ? "" : " dropped")
+);
+
+// the state machine handled an event
+TRACE_EVENT(mytraffic_transition,
+    TP_PROTO(unsigned int light, unsigned int event, unsigned int prev_mode, unsigned int next_mode),
+    TP_ARGS(light, event, prev_mode, next_mode),
+    TP_STRUCT__entry(
+        __field(unsigned int, light)
+        __field(unsigned int, event)
+        __field(unsigned int, prev_mode)
+        __field(unsigned int, next_mode)
+    ),
+    TP_fast_assign(
+        __entry->light = light;
+        __entry->event = event;
+        __entry->prev_mode = prev_mode;
+        __entry->next_mode = next_mode;
+    ),
+    TP_printk("light=%u event=%s %s -> %s", __entry->light, show_mytraffic_event(__entry->event),
+        show_mytraffic_mode(__entry->prev_mode), show_mytraffic_mode(__entry->next_mode))
+);
+
+// new lamp state written to the GPIOs
+TRACE_EVENT(mytraffic_lamps,
+    TP_PROTO(unsigned int light, unsigned long lamps),
+    TP_ARGS(light, lamps),
+    TP_STRUCT__entry(
+        __field(unsigned int, light)
+        __field(unsigned long, lamps)
+    ),
+    TP_fast_assign(
+        __entry->light = light;
+        __entry->lamps = lamps;
+    ),
+    TP_printk("light=%u lamps=%s", __entry->light, show_mytraffic_lamps(__entry->lamps))
+);
+
+// button IRQ, accepted or rejected by the debounce
+TRACE_EVENT(mytraffic_irq,
+    TP_PROTO(unsigned int light, unsigned int button, bool accepted),
+    TP_ARGS(light, button, accepted),
+    TP_STRUCT__entry(
+        __field(unsigned int, light)
+        __field(unsigned int, button)
+        __field(bool, accepted)
+    ),
+    TP_fast_assign(
+        __entry->light = light;
+        __entry->button = button;
+        __entry->accepted = accepted;
+    ),
+    TP_printk("light=%u btn=%u %s", __entry->light, __entry->button,
+        __entry->accepted ? "accepted" : "debounced")
+);
+
+// phase timer fired, lateness relative to its deadline
+TRACE_EVENT(mytraffic_timer,
+    TP_PROTO(unsigned int light, s64 lateness_ns),
+    TP_ARGS(light, lateness_ns),
+    TP_STRUCT__entry(
+        __field(unsigned int, light)
+        __field(s64, lateness_ns)
+    ),
+    TP_fast_assign(
+        __entry->light = light;
+        __entry->lateness_ns = lateness_ns;
+    ),
+    TP_printk("light=%u lateness=%lld ns", __entry->light, __entry->lateness_ns)
+);
+
+#endif
+
+// this header lives next to the module source, not under include/trace/events
+#undef TRACE_INCLUDE_PATH
+#define TRACE_INCLUDE_PATH .
+#undef TRACE_INCLUDE_FILE
+#define TRACE_INCLUDE_FILE mytraffic_trace
+#include <trace/define_trace.h>
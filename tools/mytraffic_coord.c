@@ -0,0 +1,76 @@
+/*
+	Set up a green wave across traffic lights of the module
+
+	Locks the given lights to one common cycle starting now, each offset from the previous one
+	by the travel time between the intersections, so a platoon leaving the first green keeps
+	meeting green lights along the corridor.
+
+	Usage: mytraffic_coord CYCLE_MS OFFSET_MS DEVICE...
+		- Device i (from 0) gets offset i * OFFSET_MS, modulo the cycle
+		- mytraffic_coord off DEVICE... returns the lights to free-running timing
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <time.h>
+#include <sys/ioctl.h>
+
+#include "mytraffic.h"
+
+static int set_coord(const char *device, const struct mytraffic_coord *coord) {
+    int fd = open(device, O_WRONLY); // the module only takes timing changes on writable files
+
+    if (fd < 0) {
+        perror(device);
+        return 1;
+    }
+    if (ioctl(fd, MYTRAFFIC_IOC_SET_COORD, coord) < 0) {
+        perror(device);
+        close(fd);
+        return 1;
+    }
+    close(fd);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    struct mytraffic_coord coord;
+    struct timespec now;
+    long long cycle_ms, offset_ms;
+    int first, i, result = 0;
+
+    memset(&coord, 0, sizeof(coord));
+    if (argc >= 3 && strcmp(argv[1], "off") == 0) {
+        for (i = 2; i < argc; i++) {
+            result |= set_coord(argv[i], &coord);
+        }
+        return result;
+    }
+    if (argc < 4) {
+        fprintf(stderr, "usage: %s CYCLE_MS OFFSET_MS DEVICE... | %s off DEVICE...\n", argv[0], argv[0]);
+        return 2;
+    }
+
+    cycle_ms = strtoll(argv[1], NULL, 0);
+    offset_ms = strtoll(argv[2], NULL, 0);
+    if (cycle_ms <= 0 || cycle_ms * 1000000LL > MYTRAFFIC_MAX_COORD_CYCLE_NS) {
+        fprintf(stderr, "cycle must be between 1 ms and one day\n");
+        return 2;
+    }
+
+    // one epoch for all lights: the module times phases on CLOCK_MONOTONIC
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    coord.epoch_ns = now.tv_sec * 1000000000LL + now.tv_nsec;
+    coord.cycle_ns = cycle_ms * 1000000LL;
+    coord.enabled = 1;
+
+    first = 3;
+    for (i = first; i < argc; i++) {
+        coord.offset_ns = (i - first) * offset_ms % cycle_ms * 1000000LL; // the module takes |offset| < cycle
+        result |= set_coord(argv[i], &coord);
+    }
+    return result;
+}
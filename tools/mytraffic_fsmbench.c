@@ -0,0 +1,136 @@
+/*
+	State machine benchmark, runs the module's FSM core (mytraffic_fsm.c) in user space
+
+	Steps a simulated traffic light through millions of events: mostly timer expiries at the
+	phase deadline, with pseudo-random button presses and lightbulb checks mixed in, then
+	reports events per second and how often each mode was entered.
+
+	Before the benchmark it checks cases of the core that once went wrong, and exits with status 1
+	if one fails.
+
+	Usage: mytraffic_fsmbench [events] [button permille] [seed]
+		- Defaults: 10000000 events, 50 button presses per 1000 events, seed 1
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "mytraffic_fsm.h"
+
+// xorshift32, deterministic for a given seed
+static u32 next_random(u32 *state) {
+    u32 x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    return *state = x;
+}
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+#define MS(ms) ((s64)(ms) * NSEC_PER_MSEC) // 64 bit on 32-bit targets too
+
+// a rate change on a coordinated light rescales the phase, not its stretch onto the grid
+static bool check_coord_rate(void) {
+    struct mytraffic_coord coord = { .cycle_ns = MS(10000), .enabled = 1 };
+    traffic_fsm_t fsm;
+    bool ok = true;
+    int i;
+
+    // 1 Hz: red to 2 s, green to 5 s, yellow to 6 s, red from 6 s (natural end 8 s) stretched to the grid at 10 s
+    traffic_fsm_init(&fsm, 0);
+    traffic_fsm_set_coord(&fsm, &coord);
+    for (i = 0; i < 3; i++) {
+        traffic_fsm_handle_event(&fsm, EVENT_TIMER_EXPIRE, fsm.deadline, 0);
+    }
+    if (fsm.status != LIGHT_RED || fsm.deadline != MS(10000)) {
+        printf("coordinated red: deadline %lld, expected 10 s\n", (long long)fsm.deadline);
+        return false;
+    }
+
+    // 0.5 Hz at 7 s: the second left of red takes 2 s, ends at 9 s, still on the grid at 10 s
+    traffic_fsm_set_rate(&fsm, 500, MS(7000));
+    if (fsm.deadline != MS(10000)) {
+        printf("rate change in a coordinated phase: deadline %lld, expected 10 s\n", (long long)fsm.deadline);
+        ok = false;
+    }
+
+    // back to 1 Hz at 9.5 s, in the stretch: nothing left to rescale
+    traffic_fsm_set_rate(&fsm, 1000, MS(9500));
+    if (fsm.deadline != MS(10000)) {
+        printf("rate change in the stretch: deadline %lld, expected 10 s\n", (long long)fsm.deadline);
+        ok = false;
+    }
+    traffic_fsm_handle_event(&fsm, EVENT_TIMER_EXPIRE, fsm.deadline, 0);
+    if (fsm.status != LIGHT_GREEN || fsm.phase_start != MS(10000)) {
+        printf("green after the coordinated red: started at %lld, expected 10 s\n", (long long)fsm.phase_start);
+        ok = false;
+    }
+    return ok;
+}
+
+int main(int argc, char **argv) {
+    unsigned long long events = argc > 1 ? strtoull(argv[1], NULL, 0) : 10000000ULL;
+    unsigned int permille = argc > 2 ? strtoul(argv[2], NULL, 0) : 50;
+    u32 seed = argc > 3 ? strtoul(argv[3], NULL, 0) : 1;
+    unsigned long long entered[NUM_MODES] = { 0 };
+    unsigned long long rearmed = 0, i;
+    unsigned long lamps = 0;
+    unsigned int buttons = 0;
+    traffic_fsm_t fsm;
+    double start, elapsed;
+    int m;
+
+    if (!seed) {
+        seed = 1; // xorshift never leaves 0
+    }
+    if (!check_coord_rate()) {
+        return 1;
+    }
+
+    traffic_fsm_init(&fsm, 0);
+    start = now_seconds();
+    for (i = 0; i < events; i++) {
+        u32 r = next_random(&seed);
+        event_t event = EVENT_TIMER_EXPIRE;
+        s64 time = fsm.deadline; // timer events happen exactly at the deadline
+        opmode_t prev_mode = fsm.mode;
+
+        if (fsm.mode == LIGHTBULB_CHECK) {
+            // lightbulb check has no deadline: release one button, then the other
+            event = EVENT_BTN_RELEASE;
+            time = fsm.phase_start + 100 * NSEC_PER_MSEC;
+            buttons = buttons == (BTN_0_DOWN | BTN_1_DOWN) ? (r >> 10) & 1 ? BTN_0_DOWN : BTN_1_DOWN : 0;
+        } else if (r % 1000 < permille) {
+            // a button press halfway through the current phase, both buttons held briefly
+            event = (r >> 10) % 16 == 0 ? EVENT_BOTH_BTNS_PRESS : (r >> 10) & 1 ? EVENT_BTN_1_PRESS : EVENT_BTN_0_PRESS;
+            time = fsm.phase_start + (fsm.deadline - fsm.phase_start) / 2;
+            buttons = event == EVENT_BOTH_BTNS_PRESS ? BTN_0_DOWN | BTN_1_DOWN : 0;
+        }
+
+        if (traffic_fsm_handle_event(&fsm, event, time, buttons)) {
+            rearmed++;
+        }
+        if (fsm.mode != prev_mode) {
+            entered[fsm.mode]++;
+        }
+        lamps ^= fsm.status; // keep the compiler from dropping the work
+    }
+    elapsed = now_seconds() - start;
+
+    printf("%llu events in %.3f s: %.1f M events/s, %.1f ns/event\n",
+        events, elapsed, events / elapsed / 1e6, elapsed * 1e9 / (events ? events : 1));
+    printf("timer re-armed %llu times, simulated time %.1f s, lamp checksum %lx\n",
+        rearmed, fsm.phase_start / 1e9, lamps);
+    for (m = 0; m < NUM_MODES; m++) {
+        printf("  entered %s: %llu\n", mode_names[m], entered[m]);
+    }
+    return 0;
+}
@@ -0,0 +1,145 @@
+/*
+	Read throughput benchmark for /dev/mytrafficN
+
+	Forks a number of monitoring processes that re-read the status of a traffic light
+	as fast as possible, then reports the total and per-process reads per second.
+
+	Usage: mytraffic_readbench [-s] [device] [processes] [seconds]
+		- Defaults: /dev/mytraffic0, 8 processes, 5 seconds
+		- -s sweeps the reader count: runs with 1, 2, 4, ... up to processes readers and prints
+		  one line per run, showing how reads of the shared status text scale with readers
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <signal.h>
+#include <time.h>
+#include <sys/wait.h>
+
+static volatile sig_atomic_t stop; // set by SIGALRM when the run is over
+
+static void on_alarm(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+// read the status in a loop until the alarm fires, report the read count through the pipe
+static int run_reader(const char *device, int seconds, int out_fd) {
+    char buf[256];
+    unsigned long long reads = 0;
+    int fd;
+
+    fd = open(device, O_RDONLY);
+    if (fd < 0) {
+        perror(device);
+        return 1;
+    }
+
+    signal(SIGALRM, on_alarm);
+    alarm(seconds);
+    while (!stop) {
+        ssize_t len = pread(fd, buf, sizeof(buf), 0); // every read at offset 0 returns the full status
+
+        if (len <= 0) {
+            if (len < 0) {
+                perror("pread");
+            } else {
+                fprintf(stderr, "%s: empty status\n", device);
+            }
+            close(fd);
+            return 1;
+        }
+        reads++;
+    }
+    close(fd);
+
+    if (write(out_fd, &reads, sizeof(reads)) != sizeof(reads)) {
+        return 1;
+    }
+    return 0;
+}
+
+// run processes readers for seconds, returns the total read count or -1 if a reader failed
+static long long run_readers(const char *device, int processes, int seconds) {
+    unsigned long long reads, total = 0;
+    int pipe_fd[2];
+    int i, status, failed = 0;
+
+    if (pipe(pipe_fd) < 0) {
+        perror("pipe");
+        return -1;
+    }
+
+    for (i = 0; i < processes; i++) {
+        pid_t pid = fork();
+
+        if (pid < 0) {
+            perror("fork");
+            exit(1);
+        }
+        if (pid == 0) {
+            close(pipe_fd[0]);
+            exit(run_reader(device, seconds, pipe_fd[1]));
+        }
+    }
+    close(pipe_fd[1]);
+
+    while (read(pipe_fd[0], &reads, sizeof(reads)) == sizeof(reads)) {
+        total += reads;
+    }
+    for (i = 0; i < processes; i++) {
+        wait(&status);
+        if (!WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+            failed++;
+        }
+    }
+    close(pipe_fd[0]);
+    if (failed) {
+        fprintf(stderr, "%d of %d readers failed\n", failed, processes);
+        return -1;
+    }
+    return total;
+}
+
+int main(int argc, char **argv) {
+    int sweep = argc > 1 && strcmp(argv[1], "-s") == 0;
+    const char *device = argc > 1 + sweep ? argv[1 + sweep] : "/dev/mytraffic0";
+    int processes = argc > 2 + sweep ? atoi(argv[2 + sweep]) : 8;
+    int seconds = argc > 3 + sweep ? atoi(argv[3 + sweep]) : 5;
+    long long total;
+    int readers;
+
+    if (processes < 1 || seconds < 1) {
+        fprintf(stderr, "Usage: %s [-s] [device] [processes] [seconds]\n", argv[0]);
+        return 1;
+    }
+
+    if (sweep) {
+        printf("%s: %d s per run\n", device, seconds);
+        printf("%8s %14s %14s\n", "readers", "total reads/s", "per reader");
+        for (readers = 1; ; readers = readers * 2 < processes ? readers * 2 : processes) {
+            fflush(stdout); // before forking, or the children print the buffered lines again
+            total = run_readers(device, readers, seconds);
+            if (total < 0) {
+                return 1;
+            }
+            printf("%8d %14.0f %14.0f\n", readers, (double)total / seconds, (double)total / seconds / readers);
+            if (readers == processes) {
+                break;
+            }
+        }
+        return 0;
+    }
+
+    total = run_readers(device, processes, seconds);
+    if (total < 0) {
+        return 1;
+    }
+    printf("%s: %d readers, %d s\n", device, processes, seconds);
+    printf("Total: %.0f reads/s\n", (double)total / seconds);
+    printf("Per reader: %.0f reads/s\n", (double)total / seconds / processes);
+    return 0;
+}
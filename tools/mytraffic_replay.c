@@ -0,0 +1,217 @@
+/*
+	Replays an input recording of the traffic light module (debugfs mytraffic/N/record)
+
+	Restores the recorded state into the module's FSM core (mytraffic_fsm.c) and feeds it every
+	recorded input at its recorded time, in virtual time, so a field incident runs again as fast
+	as the core can go. After each input the outputs (mode, lamps, pedestrian flag, deadline) are
+	compared with what the module produced; the first difference is reported and ends the replay.
+
+	Usage: mytraffic_replay [-v] [recording]
+		- Reads standard input without a file
+		- -v prints every input and the resulting mode and lamps
+		- Exit status: 0 replayed identically, 1 diverged, 2 unreadable recording
+*/
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "mytraffic_fsm.h"
+
+static double now_seconds(void) {
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// read the whole recording, so the replay itself is timed without I/O
+static unsigned char *load(FILE *in, size_t *len) {
+    unsigned char *data = NULL;
+    size_t cap = 0, n;
+
+    *len = 0;
+    do {
+        if (*len == cap) {
+            unsigned char *grown = realloc(data, cap = cap ? cap * 2 : 65536);
+
+            if (!grown) {
+                free(data);
+                return NULL;
+            }
+            data = grown;
+        }
+        n = fread(data + *len, 1, cap - *len, in);
+        *len += n;
+    } while (n);
+    return data;
+}
+
+static void print_lamps(unsigned long lamps) {
+    printf("%c%c%c", lamps & LIGHT_RED ? 'R' : '-', lamps & LIGHT_YELLOW ? 'Y' : '-', lamps & LIGHT_GREEN ? 'G' : '-');
+}
+
+// true if the core ended up where the module did after this record
+static bool outputs_match(const traffic_fsm_t *fsm, const struct mytraffic_record *rec) {
+    return fsm->mode == rec->mode && fsm->status == rec->lamps &&
+        fsm->pedestrian_present == !!rec->pedestrian_present && fsm->deadline == rec->deadline_ns;
+}
+
+static void report(const char *what, const traffic_fsm_t *fsm, const struct mytraffic_record *rec) {
+    printf("%s: recorded %s ", what, rec->mode < NUM_MODES ? mode_names[rec->mode] : "?");
+    print_lamps(rec->lamps);
+    printf(" ped %u deadline %lld, replayed %s ", rec->pedestrian_present, (long long)rec->deadline_ns, mode_names[fsm->mode]);
+    print_lamps(fsm->status);
+    printf(" ped %u deadline %lld\n", fsm->pedestrian_present, (long long)fsm->deadline);
+}
+
+int main(int argc, char **argv) {
+    int verbose = argc > 1 && strcmp(argv[1], "-v") == 0;
+    const char *path = argc > 1 + verbose ? argv[1 + verbose] : NULL;
+    FILE *in = path ? fopen(path, "rb") : stdin;
+    unsigned long long records = 0;
+    struct mytraffic_fsm_state state;
+    struct mytraffic_program program;
+    struct mytraffic_coord coord;
+    struct mytraffic_record rec;
+    unsigned char *data;
+    size_t len, off = 0;
+    traffic_fsm_t fsm;
+    s64 first = 0, last = 0;
+    double start, elapsed;
+    bool started = false;
+
+    if (!in) {
+        perror(path);
+        return 2;
+    }
+    data = load(in, &len);
+    if (path) {
+        fclose(in);
+    }
+    if (!data) {
+        fprintf(stderr, "out of memory\n");
+        return 2;
+    }
+
+    start = now_seconds();
+    while (off + sizeof(rec) <= len) {
+        memcpy(&rec, data + off, sizeof(rec));
+        off += sizeof(rec);
+        if (off + rec.size > len) {
+            fprintf(stderr, "record %llu: truncated\n", records);
+            return 2;
+        }
+
+        if (!started && rec.type != MYTRAFFIC_REC_STATE) {
+            fprintf(stderr, "recording does not start with the light's state\n");
+            return 2;
+        }
+
+        switch (rec.type) {
+            case MYTRAFFIC_REC_STATE: // start of a recording, maybe one of several concatenated
+                if (rec.value != MYTRAFFIC_RECORD_VERSION || rec.size != sizeof(state)) {
+                    fprintf(stderr, "record %llu: unsupported recording version %u\n", records, rec.value);
+                    return 2;
+                }
+                memcpy(&state, data + off, sizeof(state));
+                if (!traffic_fsm_restore(&fsm, &state)) {
+                    fprintf(stderr, "record %llu: invalid state\n", records);
+                    return 2;
+                }
+                if (!started) {
+                    first = rec.time_ns;
+                }
+                started = true;
+                break;
+            case MYTRAFFIC_REC_EVENT:
+                if (rec.event >= NUM_EVENTS) {
+                    fprintf(stderr, "record %llu: unknown event %u\n", records, rec.event);
+                    return 2;
+                }
+                // the module handles a timer expiry only at the deadline it armed
+                if (rec.event == EVENT_TIMER_EXPIRE && rec.time_ns != fsm.deadline) {
+                    printf("record %llu: timer expired at %lld, replayed deadline %lld\n",
+                        records, (long long)rec.time_ns, (long long)fsm.deadline);
+                    return 1;
+                }
+                traffic_fsm_handle_event(&fsm, rec.event, rec.time_ns, rec.buttons);
+                break;
+            case MYTRAFFIC_REC_RATE:
+                if (rec.value < MYTRAFFIC_MIN_RATE_MHZ || rec.value > MYTRAFFIC_MAX_RATE_MHZ) {
+                    fprintf(stderr, "record %llu: invalid rate %u mHz\n", records, rec.value);
+                    return 2;
+                }
+                traffic_fsm_set_rate(&fsm, rec.value, rec.time_ns);
+                break;
+            case MYTRAFFIC_REC_PROGRAM:
+                if (rec.size != sizeof(program)) {
+                    fprintf(stderr, "record %llu: invalid program\n", records);
+                    return 2;
+                }
+                memcpy(&program, data + off, sizeof(program));
+                if (!traffic_fsm_check_program(&program)) {
+                    fprintf(stderr, "record %llu: invalid program\n", records);
+                    return 2;
+                }
+                traffic_fsm_set_program(&fsm, &program);
+                break;
+            case MYTRAFFIC_REC_COORD:
+                if (rec.size != sizeof(coord)) {
+                    fprintf(stderr, "record %llu: invalid coordination\n", records);
+                    return 2;
+                }
+                memcpy(&coord, data + off, sizeof(coord));
+                if (!traffic_fsm_check_coord(&coord)) {
+                    fprintf(stderr, "record %llu: invalid coordination\n", records);
+                    return 2;
+                }
+                traffic_fsm_set_coord(&fsm, &coord);
+                break;
+            default:
+                fprintf(stderr, "record %llu: unknown type %u\n", records, rec.type);
+                return 2;
+        }
+        off += rec.size;
+
+        if (!outputs_match(&fsm, &rec)) {
+            char what[64];
+
+            snprintf(what, sizeof(what), "record %llu diverged", records);
+            report(what, &fsm, &rec);
+            return 1;
+        }
+        if (verbose) {
+            printf("%12.6f ", (rec.time_ns - first) / 1e9);
+            if (rec.type == MYTRAFFIC_REC_EVENT) {
+                printf("%-16s", event_names[rec.event]);
+            } else if (rec.type == MYTRAFFIC_REC_RATE) {
+                printf("rate %-11.3g", rec.value / 1000.0);
+            } else {
+                printf("%-16s", rec.type == MYTRAFFIC_REC_STATE ? "state" : rec.type == MYTRAFFIC_REC_PROGRAM ? "program" : "coord");
+            }
+            printf(" %-16s ", mode_names[fsm.mode]);
+            print_lamps(fsm.status);
+            printf("\n");
+        }
+        last = rec.time_ns;
+        records++;
+    }
+    elapsed = now_seconds() - start;
+    free(data);
+
+    if (off != len) {
+        fprintf(stderr, "%zu trailing bytes ignored\n", len - off);
+    }
+    if (!started) {
+        fprintf(stderr, "empty recording\n");
+        return 2;
+    }
+    printf("%llu records over %.3f s replayed identically in %.3f ms", records, (last - first) / 1e9, elapsed * 1e3);
+    if (elapsed > 0) {
+        printf(" (%.0fx real time)", (last - first) / 1e9 / elapsed);
+    }
+    printf("\n");
+    return 0;
+}
@@ -0,0 +1,123 @@
+#!/bin/sh
+#
+# Run the traffic light module on simulated GPIOs (gpio-sim), e.g. in an x86 VM without hardware
+#
+# Build with "make host" first. One gpio-sim bank provides 5 lines per light in the module's pin
+# order (red, yellow, green, btn0, btn1); the module is loaded with gpio_base pointing at it.
+#
+# Usage (as root):
+#	mytraffic_sim.sh start [lights] [module args...]	create the bank and load ../mytraffic.ko
+#	mytraffic_sim.sh press LIGHT 0|1			hold a button down (rising edge)
+#	mytraffic_sim.sh release LIGHT 0|1			let a button go
+#	mytraffic_sim.sh lamps LIGHT				print the lamp lines, e.g. "R-- 100"
+#	mytraffic_sim.sh events LIGHT				drain the transition log: "time_ns event mode R--"
+#	mytraffic_sim.sh watch LIGHT [seconds]			print every handled event with its kernel timestamp
+#	mytraffic_sim.sh stop					unload the module and remove the bank
+#
+# Needs CONFIG_GPIO_SIM, configfs and debugfs mounted. tools/mytraffic_test.sh checks the module with it.
+
+set -e
+
+SIM=/sys/kernel/config/gpio-sim/mytraffic
+MODULE=$(dirname "$0")/../mytraffic.ko
+
+die() {
+	echo "$*" >&2
+	exit 1
+}
+
+# sysfs directory of simulated line $1
+line_dir() {
+	echo "/sys/devices/platform/$(cat $SIM/dev_name)/$(cat $SIM/bank0/chip_name)/sim_gpio$1"
+}
+
+# global GPIO number of the first line of the bank, as the module's gpio_base
+# (not /sys/class/gpio/$chip: those nodes are named after a base, so it can be another chip)
+chip_base() {
+	chip=$(cat $SIM/bank0/chip_name)
+	if [ -r /sys/bus/gpio/devices/$chip/base ]; then
+		cat /sys/bus/gpio/devices/$chip/base
+	else
+		sed -n "s/^$chip: GPIOs \([0-9]*\)-.*/\1/p" /sys/kernel/debug/gpio
+	fi
+}
+
+start() {
+	lights=${1:-1}
+	[ $# -gt 0 ] && shift
+	modprobe gpio-sim
+	[ -d $SIM ] && die "already started, run $0 stop first"
+	mkdir $SIM $SIM/bank0
+	echo $((lights * 5)) > $SIM/bank0/num_lines
+	echo mytraffic-sim > $SIM/bank0/label
+	echo 1 > $SIM/live
+	base=$(chip_base)
+	[ -n "$base" ] || die "cannot find the GPIO base of $(cat $SIM/bank0/chip_name)"
+	# light 0 replaces the default BeagleBone pins, the others follow from gpio_base
+	insmod "$MODULE" num_lights=$lights pins=$base,$((base + 1)),$((base + 2)),$((base + 3)),$((base + 4)) \
+		gpio_base=$((base + 5)) "$@"
+	echo "$lights light(s) on GPIOs $base-$((base + lights * 5 - 1))"
+}
+
+stop() {
+	rmmod mytraffic 2>/dev/null || true
+	if [ -d $SIM ]; then
+		echo 0 > $SIM/live
+		rmdir $SIM/bank0 $SIM
+	fi
+}
+
+button() {
+	[ "$3" = 0 ] || [ "$3" = 1 ] || die "button must be 0 or 1"
+	echo "$1" > "$(line_dir $(($2 * 5 + 3 + $3)))/pull"
+}
+
+# MYTRAFFIC_LAMP_* bitmask $1 as "RYG" with - for the lamps that are off
+lamp_name() {
+	case $1 in
+		0) echo --- ;; 1) echo R-- ;; 2) echo -Y- ;; 3) echo RY- ;;
+		4) echo --G ;; 5) echo R-G ;; 6) echo -YG ;; *) echo RYG ;;
+	esac
+}
+
+lamps() {
+	first=$(($1 * 5))
+	r=$(cat "$(line_dir $first)/value")
+	y=$(cat "$(line_dir $((first + 1)))/value")
+	g=$(cat "$(line_dir $((first + 2)))/value")
+	echo "$(lamp_name $((r | y << 1 | g << 2))) $r$y$g"
+}
+
+# drain the transition log (struct mytraffic_log_entry, little endian): one line per handled event
+events() {
+	od -An -v -w16 -t d8 /sys/kernel/debug/mytraffic/$1/log | while read -r time info; do
+		echo "$time $((info & 255)) $((info >> 16 & 255)) $(lamp_name $((info >> 24 & 255)))"
+	done
+}
+
+# the log keeps the time of every deadline and press, so polling it every 100 ms loses no precision
+watch() {
+	polls=$(( ${2:-10} * 10 ))
+	while [ $polls -gt 0 ]; do
+		events "$1" | while read -r time event mode lamps; do
+			case $mode in
+				0) mode=normal ;; 1) mode=flashing-red ;; 2) mode=flashing-yellow ;;
+				3) mode=pedestrian ;; *) mode=lightbulb-check ;;
+			esac
+			printf '%d.%09d %s %s\n' $((time / 1000000000)) $((time % 1000000000)) "$lamps" $mode
+		done
+		sleep 0.1
+		polls=$((polls - 1))
+	done
+}
+
+case "$1" in
+	start) shift; start "$@" ;;
+	stop) stop ;;
+	press) button pull-up "$2" "$3" ;;
+	release) button pull-down "$2" "$3" ;;
+	lamps) lamps "$2" ;;
+	events) events "$2" ;;
+	watch) watch "$2" "$3" ;;
+	*) die "usage: $0 start [lights] [module args...] | press|release LIGHT 0|1 | lamps LIGHT | events LIGHT | watch LIGHT [seconds] | stop" ;;
+esac
@@ -0,0 +1,163 @@
+#!/bin/sh
+#
+# Check the traffic light module on simulated GPIOs (gpio-sim, see mytraffic_sim.sh)
+#
+# Loads one light with the default program and checks, from the module's transition log:
+#	- the normal sequence green 3 / yellow 1 / red 2 cycles at 1 Hz
+#	- a pedestrian call: red+yellow for 5 cycles, then green
+#	- the lightbulb check: all lamps on while both buttons are held, no phase timed meanwhile,
+#	  and normal mode from green at 1 Hz after the release
+# Phase lengths come from the kernel timestamps in the log, so the script's own scheduling does not
+# skew them; after every step the lamp lines must show the lamps the module logged last.
+#
+# Usage (as root, after "make host"):
+#	mytraffic_test.sh [tolerance_ms]	allowed phase length error, default 5 ms
+#
+# Exit status: 0 if everything matched, 1 on any mismatch.
+
+SIM="$(dirname "$0")/mytraffic_sim.sh"
+TOL=$(( ${1:-5} * 1000000 ))
+CYCLE=1000000000 # ns at the default 1 Hz
+LOG=$(mktemp)
+PHASES=$(mktemp)
+failures=0
+
+fail() {
+	echo "FAIL: $*"
+	failures=$((failures + 1))
+}
+
+cleanup() {
+	"$SIM" stop
+	rm -f "$LOG" "$PHASES"
+}
+
+# append the events handled since the last call to $LOG
+collect() {
+	"$SIM" events 0 >> "$LOG"
+}
+
+# start a new step: forget what was logged so far
+reset_log() {
+	collect
+	: > "$LOG"
+}
+
+# the lamp lines must show what the module logged last (retried once, a phase may have just ended)
+check_lamps() {
+	for try in 1 2; do
+		collect
+		want=$(tail -n 1 "$LOG" | cut -d ' ' -f 4)
+		got=$("$SIM" lamps 0 | cut -d ' ' -f 1)
+		[ -z "$want" ] || [ "$got" = "$want" ] && return
+	done
+	fail "$1: lamp lines show $got, the module logged $want"
+}
+
+# the last logged event, mode and lamps must be $2 $3 $4
+check_last() {
+	last=$(tail -n 1 "$LOG" | cut -d ' ' -f 2-)
+	[ "$last" = "$2 $3 $4" ] || fail "$1: last event/mode/lamps '$last', expected '$2 $3 $4'"
+}
+
+# lamp phases in $LOG: "start lamps length_ns" for every phase that has ended
+phases() {
+	start=
+	lamps=
+	while read -r time event mode now; do
+		if [ "$now" != "$lamps" ]; then
+			[ -n "$start" ] && echo "$start $lamps $((time - start))"
+			start=$time
+			lamps=$now
+		fi
+	done < "$LOG" > "$PHASES"
+}
+
+# phase length $2 must be $3 cycles within the tolerance
+check_length() {
+	error=$(($2 - $3 * CYCLE))
+	[ $error -le $TOL ] && [ $error -ge $((-TOL)) ] ||
+		fail "$1: lasted $2 ns, expected $3 cycles"
+}
+
+trap cleanup EXIT
+trap 'exit 1' INT TERM
+"$SIM" start 1 || exit 1
+sleep 1
+
+echo "normal sequence (about 12 s)"
+reset_log
+sleep 12
+check_lamps "normal sequence"
+phases
+prev=
+count=0
+while read -r start lamps length; do
+	case $lamps in
+		--G) cycles=3 after=-Y- ;;
+		-Y-) cycles=1 after=R-- ;;
+		R--) cycles=2 after=--G ;;
+		*) fail "normal sequence: unexpected lamps $lamps"; continue ;;
+	esac
+	[ -z "$prev" ] || [ "$lamps" = "$prev" ] || fail "normal sequence: $lamps where $prev was due"
+	check_length "normal sequence $lamps" $length $cycles
+	prev=$after
+	count=$((count + 1))
+done < "$PHASES"
+[ $count -ge 4 ] || fail "normal sequence: $count phases in 12 s, expected at least 4"
+grep -qv ' 3 0 ' "$LOG" && fail "normal sequence: events other than timer expiries in normal mode"
+
+echo "pedestrian crossing (about 12 s)"
+reset_log
+"$SIM" press 0 1
+sleep 0.2
+"$SIM" release 0 1
+sleep 12
+check_lamps "pedestrian crossing"
+grep -q ' 1 3 ' "$LOG" || fail "pedestrian crossing: no button 1 press switching to pedestrian mode"
+phases
+crossing=$(grep ' RY- ' "$PHASES" | head -n 1)
+if [ -z "$crossing" ]; then
+	fail "pedestrian crossing: no red+yellow phase"
+else
+	set -- $crossing
+	check_length "pedestrian crossing RY-" $3 5
+	after=$(awk -v end=$(($1 + $3)) '$1 == end { print $4; exit }' "$LOG")
+	[ "$after" = "--G" ] || fail "pedestrian crossing: $after after red+yellow, expected green"
+fi
+
+echo "lightbulb check (about 7 s)"
+reset_log
+"$SIM" press 0 0
+"$SIM" press 0 1
+sleep 0.3
+check_lamps "lightbulb check pressed"
+check_last "lightbulb check pressed" 2 4 RYG
+sleep 3
+collect
+check_last "lightbulb check held" 2 4 RYG
+"$SIM" release 0 0
+sleep 0.3
+check_lamps "lightbulb check one button released"
+check_last "lightbulb check one button released" 5 4 RYG
+"$SIM" release 0 1
+sleep 0.3
+check_lamps "lightbulb check released"
+check_last "lightbulb check released" 5 0 --G
+released=$(tail -n 1 "$LOG" | cut -d ' ' -f 1)
+sleep 3.5
+check_lamps "after the lightbulb check"
+phases
+green=$(grep "^$released " "$PHASES")
+if [ -z "$green" ]; then
+	fail "after the lightbulb check: green did not end"
+else
+	set -- $green
+	check_length "after the lightbulb check --G" $3 3
+fi
+
+if [ $failures -ne 0 ]; then
+	echo "$failures check(s) failed"
+	exit 1
+fi
+echo "all checks passed"